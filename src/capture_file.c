@@ -0,0 +1,150 @@
+#include "capture_file.h"
+
+//Opens the first recording file for the given interface
+//Returns 0 on success; otherwise non-zero
+int openRecorder(struct captureRecorder *recorder, const char *prefix, const char *interface,
+        unsigned long maxBytes, int snaplen) {
+
+    recorder->prefix = prefix;
+    recorder->interface = interface;
+    recorder->maxBytes = maxBytes;
+    recorder->fileIndex = 0;
+    recorder->dumper = NULL;
+
+    recorder->deadHandle = pcap_open_dead(DLT_IEEE802_11_RADIO, snaplen);
+    if (recorder->deadHandle == NULL) {
+        fprintf(stderr, "Error creating recording handle.\n");
+        return 1;
+    }
+
+    if (rotateRecorder(recorder)) {
+        pcap_close(recorder->deadHandle);
+        recorder->deadHandle = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+//Flushes and closes the current recording file
+void closeRecorder(struct captureRecorder *recorder) {
+    if (recorder->dumper != NULL) {
+        pcap_dump_close(recorder->dumper);
+        recorder->dumper = NULL;
+    }
+    if (recorder->deadHandle != NULL) {
+        pcap_close(recorder->deadHandle);
+        recorder->deadHandle = NULL;
+    }
+}
+
+//Writes the frame to the current file, moving to the next file once it is full
+//Only to be called from the thread capturing the recorder's interface
+void recordFrame(struct captureRecorder *recorder, const struct pcap_pkthdr *header,
+        const u_char *packet) {
+
+    if (recorder->dumper == NULL) {
+        return;
+    }
+
+    pcap_dump((u_char *)recorder->dumper, header, packet);
+    recorder->written += sizeof(struct pcap_pkthdr) + header->caplen;
+
+    if (recorder->written >= recorder->maxBytes) {
+        rotateRecorder(recorder);
+    }
+}
+
+//Closes the current file and starts the next, overwriting the oldest
+//Returns 0 on success; otherwise non-zero and recording stops
+int rotateRecorder(struct captureRecorder *recorder) {
+    char path[RECORD_PATH_SIZE];
+
+    if (recorder->dumper != NULL) {
+        pcap_dump_close(recorder->dumper);
+        recorder->fileIndex = (recorder->fileIndex + 1) % RECORD_FILES;
+    }
+
+    snprintf(path, sizeof(path), "%s-%s-%u.pcap", recorder->prefix, recorder->interface,
+             recorder->fileIndex);
+    recorder->written = 0;
+    recorder->dumper = pcap_dump_open(recorder->deadHandle, path);
+    if (recorder->dumper == NULL) {
+        fprintf(stderr, "Error opening recording file %s: %s\n", path,
+                pcap_geterr(recorder->deadHandle));
+        return 1;
+    }
+    return 0;
+}
+
+//Opens a pcap file of radiotap frames for replaying
+//Returns the handle or NULL on error
+pcap_t *openReplay(const char *path) {
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t *handle;
+
+    handle = pcap_open_offline(path, errbuf);
+    if (handle == NULL) {
+        fprintf(stderr, "pcap_open_offline: %s\n", errbuf);
+        return NULL;
+    }
+
+    if (pcap_datalink(handle) != DLT_IEEE802_11_RADIO) {
+        fprintf(stderr, "%s does not hold radiotap frames.\n", path);
+        pcap_close(handle);
+        return NULL;
+    }
+    return handle;
+}
+
+//Passes every frame in the file to the callback, either as fast as possible
+//or paced to the gaps between the recorded timestamps
+//Returns 0 at the end of the file or when running is cleared; otherwise non-zero
+int replayLoop(pcap_t *handle, volatile char *running, char paced, pcap_handler callback,
+        u_char *args, struct replayStats *stats) {
+
+    struct pcap_pkthdr *header;
+    const u_char *packet;
+    struct timespec start;
+    struct timespec end;
+    struct timespec due;
+    struct timeval first = {0, 0};
+    double offset = 0.0;
+    int retval = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (*running && (retval = pcap_next_ex(handle, &header, &packet)) == 1) {
+        if (stats->frames == 0) {
+            first = header->ts;
+        }
+        offset = (header->ts.tv_sec - first.tv_sec) + (header->ts.tv_usec - first.tv_usec) / 1e6;
+
+        if (paced && offset > 0.0) {
+            due.tv_sec = start.tv_sec + (time_t)offset;
+            due.tv_nsec = start.tv_nsec + (long)((offset - (time_t)offset) * 1e9);
+            if (due.tv_nsec >= 1000000000L) {
+                due.tv_sec++;
+                due.tv_nsec -= 1000000000L;
+            }
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR) {
+                if (!*running) {
+                    break;
+                }
+            }
+        }
+
+        callback(args, header, packet);
+        stats->frames++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats->seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    stats->recordedSeconds = offset;
+
+    if (*running && retval == -1) {
+        fprintf(stderr, "Error reading replay file: %s\n", pcap_geterr(handle));
+        return 1;
+    }
+    return 0;
+}
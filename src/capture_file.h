@@ -0,0 +1,45 @@
+#ifndef CAPTURE_FILE
+#define CAPTURE_FILE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include <pcap.h>
+
+#define RECORD_FILE_SIZE 64     //Default megabytes in each recording file
+#define RECORD_FILES 8          //Recording files kept before the oldest is overwritten
+#define RECORD_PATH_SIZE 256
+
+//Struct for writing captured frames to a rotating set of pcap files
+//Files are named prefix-interface-N.pcap with N counting round RECORD_FILES
+struct captureRecorder {
+    pcap_t *deadHandle;         //Describes the link type of the files
+    pcap_dumper_t *dumper;      //Current file, NULL if not recording
+    const char *prefix;
+    const char *interface;
+    unsigned long maxBytes;     //Size a file is rotated at
+    unsigned long written;      //Bytes in the current file
+    unsigned int fileIndex;
+};
+
+//Struct for the outcome of replaying a file
+struct replayStats {
+    unsigned long frames;
+    double seconds;             //Wall time taken to replay
+    double recordedSeconds;     //Time between the first and last frame in the file
+};
+
+int openRecorder(struct captureRecorder *recorder, const char *prefix, const char *interface,
+        unsigned long maxBytes, int snaplen);
+void closeRecorder(struct captureRecorder *recorder);
+void recordFrame(struct captureRecorder *recorder, const struct pcap_pkthdr *header,
+        const u_char *packet);
+int rotateRecorder(struct captureRecorder *recorder);
+pcap_t *openReplay(const char *path);
+int replayLoop(pcap_t *handle, volatile char *running, char paced, pcap_handler callback,
+        u_char *args, struct replayStats *stats);
+
+#endif
@@ -0,0 +1,230 @@
+#include "capture_ring.h"
+
+//Opens an AF_PACKET socket on the given device with a TPACKET_V3 ring mapped in
+//Returns 0 on success; otherwise -1
+int openRing(struct captureRing *ring, const char *device) {
+    int version = TPACKET_V3;
+    struct sockaddr_ll addr;
+
+    ring->fd = -1;
+    ring->map = NULL;
+    ring->blockIndex = 0;
+
+    ring->fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (ring->fd < 0) {
+        fprintf(stderr, "Error creating packet socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version))) {
+        fprintf(stderr, "Error setting TPACKET_V3: %s\n", strerror(errno));
+        closeRing(ring);
+        return -1;
+    }
+
+    memset(&ring->req, 0, sizeof(ring->req));
+    ring->req.tp_block_size = RING_BLOCK_SIZE;
+    ring->req.tp_block_nr = RING_BLOCK_NUM;
+    ring->req.tp_frame_size = RING_FRAME_SIZE;
+    ring->req.tp_frame_nr = (RING_BLOCK_SIZE / RING_FRAME_SIZE) * RING_BLOCK_NUM;
+    ring->req.tp_retire_blk_tov = RING_BLOCK_TIMEOUT;
+
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING, &ring->req, sizeof(ring->req))) {
+        fprintf(stderr, "Error creating capture ring: %s\n", strerror(errno));
+        closeRing(ring);
+        return -1;
+    }
+
+    ring->map = mmap(NULL, ring->req.tp_block_size * ring->req.tp_block_nr,
+                     PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+    if (ring->map == MAP_FAILED) {
+        fprintf(stderr, "Error mapping capture ring: %s\n", strerror(errno));
+        ring->map = NULL;
+        closeRing(ring);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ALL);
+    addr.sll_ifindex = if_nametoindex(device);
+    if (addr.sll_ifindex == 0 || bind(ring->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        fprintf(stderr, "Error binding to interface %s: %s\n", device, strerror(errno));
+        closeRing(ring);
+        return -1;
+    }
+
+    return 0;
+}
+
+//Unmaps the ring and closes the socket
+void closeRing(struct captureRing *ring) {
+    if (ring->map != NULL) {
+        munmap(ring->map, ring->req.tp_block_size * ring->req.tp_block_nr);
+        ring->map = NULL;
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+}
+
+//Compiles the given pcap filter expression for radiotap frames and attaches it
+//to the ring socket. The program returns snaplen for accepted frames so the
+//kernel only copies that many bytes into the ring.
+//Returns 0 on success; otherwise -1
+int attachRingFilter(struct captureRing *ring, const char *filter, int snaplen) {
+    pcap_t *deadHandle;
+    struct bpf_program program;
+    struct sock_fprog sockProgram;
+    int retval = 0;
+
+    //libpcap generates radiotap length aware code for this link type
+    deadHandle = pcap_open_dead(DLT_IEEE802_11_RADIO, snaplen);
+    if (deadHandle == NULL) {
+        fprintf(stderr, "Error creating handle to compile filter.\n");
+        return -1;
+    }
+
+    if (pcap_compile(deadHandle, &program, filter, 1, PCAP_NETMASK_UNKNOWN)) {
+        fprintf(stderr, "Error compiling filter: %s\n", pcap_geterr(deadHandle));
+        pcap_close(deadHandle);
+        return -1;
+    }
+
+    sockProgram.len = program.bf_len;
+    sockProgram.filter = (struct sock_filter *)program.bf_insns;
+    if (setsockopt(ring->fd, SOL_SOCKET, SO_ATTACH_FILTER, &sockProgram, sizeof(sockProgram))) {
+        fprintf(stderr, "Error attaching filter: %s\n", strerror(errno));
+        retval = -1;
+    }
+
+    pcap_freecode(&program);
+    pcap_close(deadHandle);
+    return retval;
+}
+
+//Adds the ring's socket to the given fanout group of the interface it is bound to,
+//or to a new group if group is negative. Group ids are shared by the whole network
+//namespace, so new groups take an id the kernel knows no other socket is using.
+//The kernel shares frames between the group's sockets by a hash of the 802.11
+//transmitter address, so every frame from a device reaches the same socket.
+//Returns the group's id on success; otherwise -1
+int joinRingFanout(struct captureRing *ring, int group) {
+    int fanout = PACKET_FANOUT_CBPF << 16;
+    socklen_t length = sizeof(fanout);
+    struct sock_fprog program;
+
+    //Transmitter is 10 bytes into the 802.11 header, which follows the radiotap header
+    struct sock_filter hashTransmitter[] = {
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 3),      //Radiotap length is little endian
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 8),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 2),
+        BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_LD | BPF_W | BPF_IND, 10),     //First 4 bytes of the transmitter
+        BPF_STMT(BPF_ST, 0),
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, 14),     //Last 2 bytes of the transmitter
+        BPF_STMT(BPF_LDX | BPF_MEM, 0),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+        BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, RING_FANOUT_MIX),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+        BPF_STMT(BPF_RET | BPF_A, 0),               //Kernel takes this modulo the group size
+    };
+
+    if (group < 0) {
+        fanout |= PACKET_FANOUT_FLAG_UNIQUEID << 16;
+    } else {
+        fanout |= group & 0xFFFF;
+    }
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout))) {
+        fprintf(stderr, "Error joining fanout group: %s\n", strerror(errno));
+        return -1;
+    }
+
+    //Find out which id the kernel gave a new group so other sockets can join it
+    if (group < 0) {
+        if (getsockopt(ring->fd, SOL_PACKET, PACKET_FANOUT, &fanout, &length)) {
+            fprintf(stderr, "Error reading fanout group: %s\n", strerror(errno));
+            return -1;
+        }
+        group = fanout & 0xFFFF;
+    }
+
+    program.len = sizeof(hashTransmitter) / sizeof(hashTransmitter[0]);
+    program.filter = hashTransmitter;
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_FANOUT_DATA, &program, sizeof(program))) {
+        fprintf(stderr, "Error setting fanout hash: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return group;
+}
+
+//Waits for filled blocks and passes every frame in them to the callback in place
+//Returns when running is cleared or an error occurs
+int ringLoop(struct captureRing *ring, volatile char *running, pcap_handler callback,
+        u_char *args) {
+
+    struct tpacket_block_desc *block;
+    struct pollfd pfd;
+
+    pfd.fd = ring->fd;
+    pfd.events = POLLIN | POLLERR;
+    pfd.revents = 0;
+
+    while (*running) {
+        block = (struct tpacket_block_desc *)(ring->map +
+                ring->blockIndex * ring->req.tp_block_size);
+
+        if ((block->hdr.bh1.block_status & TP_STATUS_USER) == 0) {
+            if (poll(&pfd, 1, RING_POLL_TIMEOUT) < 0 && errno != EINTR) {
+                fprintf(stderr, "Error polling capture ring: %s\n", strerror(errno));
+                return -1;
+            }
+            continue;
+        }
+
+        walkBlock(block, callback, args);
+
+        //Hand block back to the kernel
+        __sync_synchronize();
+        block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        ring->blockIndex = (ring->blockIndex + 1) % ring->req.tp_block_nr;
+    }
+
+    return 0;
+}
+
+//Calls the callback for every frame in the given block without copying
+void walkBlock(struct tpacket_block_desc *block, pcap_handler callback, u_char *args) {
+    struct tpacket3_hdr *frame;
+    struct pcap_pkthdr header;
+    unsigned int numFrames = block->hdr.bh1.num_pkts;
+
+    frame = (struct tpacket3_hdr *)((unsigned char *)block +
+            block->hdr.bh1.offset_to_first_pkt);
+
+    for (unsigned int i = 0; i < numFrames; i++) {
+        header.ts.tv_sec = frame->tp_sec;
+        header.ts.tv_usec = frame->tp_nsec / 1000;
+        header.caplen = frame->tp_snaplen;
+        header.len = frame->tp_len;
+        callback(args, &header, (unsigned char *)frame + frame->tp_mac);
+
+        frame = (struct tpacket3_hdr *)((unsigned char *)frame + frame->tp_next_offset);
+    }
+}
+
+//Reads the kernel's drop counter for the ring, which resets on every read
+//Returns the number of frames dropped since the last call
+unsigned long getRingDrops(struct captureRing *ring) {
+    struct tpacket_stats_v3 stats;
+    socklen_t length = sizeof(stats);
+
+    if (ring->fd < 0 || getsockopt(ring->fd, SOL_PACKET, PACKET_STATISTICS, &stats, &length)) {
+        return 0;
+    }
+    return stats.tp_drops;
+}
@@ -0,0 +1,49 @@
+#ifndef CAPTURE_RING
+#define CAPTURE_RING
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <poll.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#include <pcap.h>
+
+#ifndef PACKET_FANOUT_FLAG_UNIQUEID
+#define PACKET_FANOUT_FLAG_UNIQUEID 0x2000  //Missing from older headers, kernels have it since 4.5
+#endif
+
+#define RING_BLOCK_SIZE (1 << 16)   //Size of each ring block, must be a multiple of page size
+#ifndef RING_BLOCK_NUM
+#define RING_BLOCK_NUM 64           //Number of blocks in the ring
+#endif
+#define RING_FRAME_SIZE 2048        //Frame size hint, TPACKET_V3 packs frames tightly
+#define RING_BLOCK_TIMEOUT 100      //Milliseconds before the kernel retires a partly filled block
+#define RING_POLL_TIMEOUT 1000      //Milliseconds to wait for a block before checking if still running
+#define RING_FANOUT_MIX 0x9E3779B1U //Spreads similar transmitter addresses across a fanout group
+
+//Struct for a TPACKET_V3 memory mapped capture ring
+struct captureRing {
+    int fd;
+    unsigned char *map;
+    struct tpacket_req3 req;
+    unsigned int blockIndex;
+};
+
+int openRing(struct captureRing *ring, const char *device);
+void closeRing(struct captureRing *ring);
+int attachRingFilter(struct captureRing *ring, const char *filter, int snaplen);
+int joinRingFanout(struct captureRing *ring, int group);
+int ringLoop(struct captureRing *ring, volatile char *running, pcap_handler callback, u_char *args);
+void walkBlock(struct tpacket_block_desc *block, pcap_handler callback, u_char *args);
+unsigned long getRingDrops(struct captureRing *ring);
+
+#endif
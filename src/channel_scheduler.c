@@ -0,0 +1,56 @@
+#include "channel_scheduler.h"
+
+//Initialises the scheduler for the given number of channels with no history
+void initScheduler(struct channelScheduler *scheduler, unsigned int numChannels) {
+    memset(scheduler, 0, sizeof(*scheduler));
+    scheduler->numChannels = numChannels;
+}
+
+//Picks the channel to dwell on for the next slot
+//Returns the index of the channel
+unsigned int nextChannel(struct channelScheduler *scheduler) {
+    double total = 0.0;
+    double weight;
+    unsigned int best = 0;
+
+    for (unsigned int i = 0; i < scheduler->numChannels; i++) {
+        weight = getChannelWeight(scheduler, i);
+        scheduler->credit[i] += weight;
+        total += weight;
+        if (scheduler->credit[i] > scheduler->credit[best]) {
+            best = i;
+        }
+    }
+
+    scheduler->credit[best] -= total;
+    scheduler->slots[best]++;
+    return best;
+}
+
+//Folds the number of distinct devices found during a slot into the channel's rate
+void updateChannelRate(struct channelScheduler *scheduler, unsigned int index,
+        unsigned int devices, double seconds) {
+
+    if (seconds <= 0.0) {
+        return;
+    }
+
+    scheduler->rate[index] += SCHED_SMOOTHING * (devices / seconds - scheduler->rate[index]);
+}
+
+//Returns the weight the channel at index gets in the round robin
+//Every channel gets a floor based on the mean rate so none is ever starved
+double getChannelWeight(struct channelScheduler *scheduler, unsigned int index) {
+    double mean = 0.0;
+
+    for (unsigned int i = 0; i < scheduler->numChannels; i++) {
+        mean += scheduler->rate[i];
+    }
+    mean /= scheduler->numChannels;
+
+    if (mean < SCHED_MIN_RATE) {
+        mean = SCHED_MIN_RATE;
+    }
+
+    return scheduler->rate[index] + SCHED_MIN_SHARE * mean;
+}
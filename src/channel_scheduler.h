@@ -0,0 +1,29 @@
+#ifndef CHANNEL_SCHEDULER
+#define CHANNEL_SCHEDULER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCHED_MAX_CHANNELS 14
+#define SCHED_SMOOTHING 0.1     //Weight of the newest slot in a channel's discovery rate
+#define SCHED_MIN_SHARE 0.25    //Fraction of the mean rate every channel is weighted by at least
+#define SCHED_MIN_RATE 0.01     //Rate used when nothing has been heard anywhere yet
+
+//Struct for choosing which channel to dwell on next
+//Channels are weighted by how many distinct devices a slot on them finds per
+//second. Smooth weighted round robin spreads each channel's slots evenly.
+struct channelScheduler {
+    unsigned int numChannels;
+    double rate[SCHED_MAX_CHANNELS];    //Smoothed distinct devices found per second
+    double credit[SCHED_MAX_CHANNELS];  //Round robin credit, the highest goes next
+    unsigned long slots[SCHED_MAX_CHANNELS];
+};
+
+void initScheduler(struct channelScheduler *scheduler, unsigned int numChannels);
+unsigned int nextChannel(struct channelScheduler *scheduler);
+void updateChannelRate(struct channelScheduler *scheduler, unsigned int index,
+        unsigned int devices, double seconds);
+double getChannelWeight(struct channelScheduler *scheduler, unsigned int index);
+
+#endif
@@ -1,5 +1,23 @@
 #include "ieee80211.h"
 
+#define IGN IEEE80211_CLASS_IGNORE
+#define TX IEEE80211_CLASS_TRANSMITTER
+
+//Class of every frame type and subtype, indexed by type * 16 + subtype
+const unsigned char ieee80211FrameClasses[64] = {
+    //Management: beacons (8) and reserved subtypes (7, 15) are ignored
+    TX,  TX,  TX,  TX,  TX,  TX,  TX,  IGN, IGN, TX,  TX,  TX,  TX,  TX,  TX,  IGN,
+    //Control: reserved (0, 1), extension (6), CTS (12) and ACK (13) are ignored
+    IGN, IGN, TX,  TX,  TX,  TX,  IGN, TX,  TX,  TX,  TX,  TX,  IGN, IGN, TX,  TX,
+    //Data: reserved subtype (13) is ignored
+    TX,  TX,  TX,  TX,  TX,  TX,  TX,  TX,  TX,  TX,  TX,  TX,  TX,  IGN, TX,  TX,
+    //Extension
+    IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN, IGN
+};
+
+#undef IGN
+#undef TX
+
 //Returns the 802.11 packet Type
 unsigned char get802Type(struct ieee80211_header *header) {
         return (header->frameControl & 0x0C) >> 2;
@@ -16,6 +16,20 @@ struct ieee80211_header {
 #define IEEE80211_CONTROL      1
 #define IEEE80211_DATA         2
 
+//Frame classes, indexed by type and subtype in ieee80211FrameClasses
+#define IEEE80211_CLASS_IGNORE      0   //Beacons, reserved frames and frames with no transmitter address
+#define IEEE80211_CLASS_TRANSMITTER 1   //Address 2 is the device that sent the frame
+
+extern const unsigned char ieee80211FrameClasses[64];
+
+//Returns the class of the frame from a single table lookup on its frame control
+static inline unsigned char get802Class(const struct ieee80211_header *header) {
+    if (header->frameControl & 0x03) {  //Only protocol version 0 is defined
+        return IEEE80211_CLASS_IGNORE;
+    }
+    return ieee80211FrameClasses[(header->frameControl >> 2) & 0x3F];
+}
+
 unsigned char get802Type(struct ieee80211_header *header);
 unsigned char get802Subtype(struct ieee80211_header *header);
 unsigned char get802ToDS(struct ieee80211_header *header);
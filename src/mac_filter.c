@@ -0,0 +1,157 @@
+#include "mac_filter.h"
+
+//Builds a filter from the given keys, which are sorted and have duplicates removed
+//Takes ownership of keys, which must have been allocated with malloc
+void buildMacFilter(struct macFilter *filter, unsigned long long *keys, unsigned int size,
+        unsigned int generation) {
+
+    unsigned int unique = 0;
+
+    qsort(keys, size, sizeof(*keys), compareKeys);
+    for (unsigned int i = 0; i < size; i++) {
+        if (unique == 0 || keys[unique - 1] != keys[i]) {
+            keys[unique++] = keys[i];
+        }
+    }
+
+    filter->keys = keys;
+    filter->size = unique;
+    filter->generation = generation;
+}
+
+//Frees the keys held by the filter
+void destroyMacFilter(struct macFilter *filter) {
+    free(filter->keys);
+    filter->keys = NULL;
+    filter->size = 0;
+}
+
+//Binary searches the filter for the given key
+//Returns 1 if it is in the filter; otherwise 0
+char isInMacFilter(struct macFilter *filter, unsigned long long key) {
+    unsigned int low = 0;
+    unsigned int high = filter->size;
+    unsigned int middle;
+
+    while (low < high) {
+        middle = (low + high) / 2;
+        if (filter->keys[middle] < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < filter->size && filter->keys[low] == key;
+}
+
+//Returns the filter key for the given 6 byte MAC
+unsigned long long macToKey(const unsigned char *mac) {
+    unsigned long long key = 0;
+
+    for (int i = 0; i < 6; i++) {
+        key = (key << 8) | mac[i];
+    }
+    return key;
+}
+
+//Returns the number of bytes the filter takes in its wire format
+unsigned int getMacFilterLength(struct macFilter *filter) {
+    return MAC_FILTER_HEADER_SIZE + filter->size * 6;
+}
+
+//Writes the filter into buffer in its wire format
+//Returns the number of bytes written or 0 if it doesn't fit
+unsigned int serialiseMacFilter(struct macFilter *filter, unsigned char *buffer, unsigned int size) {
+    unsigned char *marker = buffer;
+    unsigned int value;
+
+    if (size < getMacFilterLength(filter)) {
+        return 0;
+    }
+
+    memset(marker, 0, MAC_FILTER_HEADER_SIZE);
+    marker[0] = MAC_FILTER_VERSION;
+    value = htole32(filter->generation);
+    memcpy(marker + 4, &value, sizeof(value));
+    value = htole32(filter->size);
+    memcpy(marker + 8, &value, sizeof(value));
+    marker += MAC_FILTER_HEADER_SIZE;
+
+    for (unsigned int i = 0; i < filter->size; i++) {
+        for (int j = 5; j >= 0; j--) {
+            marker[j] = (filter->keys[i] >> (8 * (5 - j))) & 0xFF;
+        }
+        marker += 6;
+    }
+
+    return marker - buffer;
+}
+
+//Reads a filter from its wire format, allocating its keys
+//Returns 0 on success or -1 if the message isn't a valid filter
+int deserialiseMacFilter(struct macFilter *filter, const unsigned char *buffer, unsigned int size) {
+    unsigned int num;
+
+    if (size < MAC_FILTER_HEADER_SIZE) {
+        return -1;
+    }
+    memcpy(&num, buffer + 8, sizeof(num));
+    num = le32toh(num);
+    //Check the length before allocating so a bad header can't cost a large allocation
+    if (num > MAC_FILTER_MAX || size != MAC_FILTER_HEADER_SIZE + num * 6) {
+        return -1;
+    }
+
+    filter->keys = malloc(num * sizeof(*filter->keys) + 1);
+    if (filter->keys == NULL) {
+        return -1;
+    }
+    if (readMacFilter(filter, num, buffer, size)) {
+        destroyMacFilter(filter);
+        return -1;
+    }
+
+    return 0;
+}
+
+//Reads a filter from its wire format into keys the filter already has room for
+//Returns 0 on success or -1 if the message isn't a valid filter or holds more than capacity MACs
+int readMacFilter(struct macFilter *filter, unsigned int capacity, const unsigned char *buffer,
+        unsigned int size) {
+
+    const unsigned char *marker = buffer + MAC_FILTER_HEADER_SIZE;
+    unsigned int generation;
+    unsigned int num;
+
+    if (size < MAC_FILTER_HEADER_SIZE || buffer[0] != MAC_FILTER_VERSION) {
+        return -1;
+    }
+    memcpy(&generation, buffer + 4, sizeof(generation));
+    memcpy(&num, buffer + 8, sizeof(num));
+    num = le32toh(num);
+    if (num > capacity || size != MAC_FILTER_HEADER_SIZE + num * 6) {
+        return -1;
+    }
+    filter->size = num;
+    filter->generation = le32toh(generation);
+
+    //The server sends them in order, so anything else is a corrupt message
+    for (unsigned int i = 0; i < num; i++) {
+        filter->keys[i] = macToKey(marker);
+        marker += 6;
+        if (i > 0 && filter->keys[i] <= filter->keys[i - 1]) {
+            filter->size = 0;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//qsort comparison for filter keys
+int compareKeys(const void *key1, const void *key2) {
+    unsigned long long a = *(const unsigned long long *)key1;
+    unsigned long long b = *(const unsigned long long *)key2;
+
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
@@ -0,0 +1,40 @@
+#ifndef MAC_FILTER
+#define MAC_FILTER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+
+//Registered MAC message the server keeps retained on REGISTERED_TOPIC
+//Header:   version (1), unused (3), generation (4), MAC count (4), all little endian
+//MACs:     each registered MAC (6) in ascending order
+//Clients reject a filter with more MACs than they hold and keep the one they had,
+//so the server warns once the registered set outgrows the smallest client
+#define REGISTERED_TOPIC "wisn/registered"
+#define MAC_FILTER_VERSION 1
+#define MAC_FILTER_HEADER_SIZE 12
+#define MAC_FILTER_MAX 1000000  //Most MACs a received filter may hold
+#define MAC_FILTER_STATIC_MAX 4096  //Most MACs the static client build holds
+
+//Struct for a sorted set of MACs, each held in the low 48 bits of a key with
+//the first byte most significant so keys sort the same way as the bytes
+struct macFilter {
+    unsigned long long *keys;
+    unsigned int size;
+    unsigned int generation;    //Changes every time the server rebuilds the set
+};
+
+void buildMacFilter(struct macFilter *filter, unsigned long long *keys, unsigned int size,
+        unsigned int generation);
+void destroyMacFilter(struct macFilter *filter);
+char isInMacFilter(struct macFilter *filter, unsigned long long key);
+unsigned long long macToKey(const unsigned char *mac);
+unsigned int getMacFilterLength(struct macFilter *filter);
+unsigned int serialiseMacFilter(struct macFilter *filter, unsigned char *buffer, unsigned int size);
+int deserialiseMacFilter(struct macFilter *filter, const unsigned char *buffer, unsigned int size);
+int readMacFilter(struct macFilter *filter, unsigned int capacity, const unsigned char *buffer,
+        unsigned int size);
+int compareKeys(const void *key1, const void *key2);
+
+#endif
@@ -0,0 +1,124 @@
+#include "mac_table.h"
+
+//Returns the bucket the given key would be in if nothing else were there
+unsigned int getHomeBucket(struct macTable *table, unsigned long long key) {
+    return (key * MAC_TABLE_MIX) >> table->shift;
+}
+
+//Allocates buckets for at least twice capacity entries
+//Returns 0 on success; otherwise -1
+int initMacTable(struct macTable *table, unsigned int capacity) {
+    unsigned int buckets = 2;
+    unsigned int bits = 1;
+
+    memset(table, 0, sizeof(*table));
+
+    while (buckets < capacity * 2) {
+        buckets <<= 1;
+        bits++;
+    }
+    table->mask = buckets - 1;
+    table->shift = 64 - bits;
+    table->capacity = capacity;
+
+    table->keys = malloc(sizeof(*table->keys) * buckets);
+    table->values = malloc(sizeof(*table->values) * buckets);
+    if (table->keys == NULL || table->values == NULL) {
+        fprintf(stderr, "Error allocating MAC table.\n");
+        destroyMacTable(table);
+        return -1;
+    }
+    for (unsigned int i = 0; i < buckets; i++) {
+        table->keys[i] = MAC_TABLE_EMPTY;
+        table->values[i] = NULL;
+    }
+
+    return 0;
+}
+
+//Frees the buckets but not the objects held in them
+void destroyMacTable(struct macTable *table) {
+    free(table->keys);
+    free(table->values);
+    table->keys = NULL;
+    table->values = NULL;
+    table->size = 0;
+}
+
+//Returns the object held for the given key or NULL if there isn't one
+void *getFromMacTable(struct macTable *table, unsigned long long key) {
+    unsigned int i = getHomeBucket(table, key);
+
+    while (table->keys[i] != MAC_TABLE_EMPTY) {
+        if (table->keys[i] == key) {
+            return table->values[i];
+        }
+        i = (i + 1) & table->mask;
+    }
+    return NULL;
+}
+
+//Holds value for the given key, replacing any value it already had
+//Returns 0 on success or -1 if the table already holds capacity entries
+int putInMacTable(struct macTable *table, unsigned long long key, void *value) {
+    unsigned int i = getHomeBucket(table, key);
+
+    while (table->keys[i] != MAC_TABLE_EMPTY) {
+        if (table->keys[i] == key) {
+            table->values[i] = value;
+            return 0;
+        }
+        i = (i + 1) & table->mask;
+    }
+
+    if (table->size >= table->capacity) {
+        return -1;
+    }
+    table->keys[i] = key;
+    table->values[i] = value;
+    table->size++;
+    return 0;
+}
+
+//Removes the given key, moving back any entries that probed past it
+//Returns the object that was held or NULL if the key wasn't in the table
+void *removeFromMacTable(struct macTable *table, unsigned long long key) {
+    unsigned int i = getHomeBucket(table, key);
+    unsigned int j;
+    unsigned int home;
+    void *value;
+
+    while (table->keys[i] != key) {
+        if (table->keys[i] == MAC_TABLE_EMPTY) {
+            return NULL;
+        }
+        i = (i + 1) & table->mask;
+    }
+    value = table->values[i];
+
+    //Fill the gap with the next entry that can't be found past it, until an empty bucket
+    for (j = (i + 1) & table->mask; table->keys[j] != MAC_TABLE_EMPTY; j = (j + 1) & table->mask) {
+        home = getHomeBucket(table, table->keys[j]);
+        if (((j - home) & table->mask) >= ((j - i) & table->mask)) {
+            table->keys[i] = table->keys[j];
+            table->values[i] = table->values[j];
+            i = j;
+        }
+    }
+    table->keys[i] = MAC_TABLE_EMPTY;
+    table->values[i] = NULL;
+    table->size--;
+
+    return value;
+}
+
+//Returns the object in the bucket at index or NULL if it is empty
+//Walking index from 0 to mask visits every object in the table
+void *getMacTableValue(struct macTable *table, unsigned int index) {
+    return table->keys[index] != MAC_TABLE_EMPTY ? table->values[index] : NULL;
+}
+
+//Returns the number of entries in the table
+unsigned int getMacTableSize(struct macTable *table) {
+    return table->size;
+}
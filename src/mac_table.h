@@ -0,0 +1,32 @@
+#ifndef MAC_TABLE
+#define MAC_TABLE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAC_TABLE_EMPTY 0xFFFFFFFFFFFFFFFFULL  //Key of an unused bucket, MAC keys only use 48 bits
+#define MAC_TABLE_MIX 0x9E3779B97F4A7C15ULL    //Spreads MACs from the same vendor across buckets
+
+//Struct for a map from MAC keys to objects that never grows once created
+//Buckets are kept at most half full and probed linearly. Removal shifts later
+//entries back rather than leaving tombstones, so the table never needs rebuilding.
+struct macTable {
+    unsigned long long *keys;
+    void **values;
+    unsigned int mask;          //Buckets - 1, the number of buckets is a power of 2
+    unsigned int shift;         //Turns a mixed key into a bucket index
+    unsigned int size;
+    unsigned int capacity;      //Most entries the table will hold
+};
+
+int initMacTable(struct macTable *table, unsigned int capacity);
+void destroyMacTable(struct macTable *table);
+unsigned int getHomeBucket(struct macTable *table, unsigned long long key);
+void *getFromMacTable(struct macTable *table, unsigned long long key);
+int putInMacTable(struct macTable *table, unsigned long long key, void *value);
+void *removeFromMacTable(struct macTable *table, unsigned long long key);
+void *getMacTableValue(struct macTable *table, unsigned int index);
+unsigned int getMacTableSize(struct macTable *table);
+
+#endif
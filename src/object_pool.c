@@ -0,0 +1,139 @@
+#include "object_pool.h"
+
+//Allocates room for capacity objects of objectSize and puts them all on the free stack
+//Returns 0 on success; otherwise -1
+int initPool(struct objectPool *pool, size_t objectSize, unsigned int capacity) {
+    memset(pool, 0, sizeof(*pool));
+
+    //Room for the free stack link and aligned for anything held
+    if (objectSize < sizeof(unsigned int)) {
+        objectSize = sizeof(unsigned int);
+    }
+    pool->objectSize = (objectSize + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+    pool->capacity = capacity;
+
+    pool->slab = malloc(pool->objectSize * capacity + 1);
+    if (pool->slab == NULL) {
+        fprintf(stderr, "Error allocating object pool.\n");
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < capacity; i++) {
+        unsigned int next = i + 1 < capacity ? i + 1 : POOL_NONE;
+        memcpy(pool->slab + i * pool->objectSize, &next, sizeof(next));
+    }
+    pool->head = capacity > 0 ? 0 : POOL_NONE;
+
+    return 0;
+}
+
+//Frees the pool's objects, whether or not they are still in use
+//No other thread may be using the pool
+void destroyPool(struct objectPool *pool) {
+    free(pool->slab);
+    pool->slab = NULL;
+    pool->capacity = 0;
+    pool->head = POOL_NONE;
+}
+
+//Initialises the given cache to hold no objects
+void initPoolCache(struct poolCache *cache) {
+    cache->count = 0;
+}
+
+//Gets an object from the cache, refilling it from the pool when it runs out
+//Falls back to the heap if the pool is empty, unless built with WISN_STATIC. cache may be NULL.
+//Returns the object or NULL if there is none
+void *poolGet(struct objectPool *pool, struct poolCache *cache) {
+    void *object;
+
+    if (cache != NULL) {
+        //Take half a cache at a time so puts from this thread don't flush it straight back
+        if (cache->count == 0) {
+            while (cache->count < POOL_CACHE_SIZE / 2 && (object = popPool(pool)) != NULL) {
+                cache->objects[cache->count++] = object;
+            }
+        }
+        if (cache->count > 0) {
+            return cache->objects[--cache->count];
+        }
+    } else if ((object = popPool(pool)) != NULL) {
+        return object;
+    }
+
+    __atomic_add_fetch(&pool->mallocs, 1, __ATOMIC_RELAXED);
+#ifdef WISN_STATIC
+    return NULL;
+#else
+    return malloc(pool->objectSize);
+#endif
+}
+
+//Returns an object to the cache, passing half of it back to the pool when full
+//Objects that came from the heap go back to it. cache may be NULL.
+void poolPut(struct objectPool *pool, struct poolCache *cache, void *object) {
+    unsigned char *address = object;
+
+    if (object == NULL) {
+        return;
+    }
+    if (address < pool->slab || address >= pool->slab + pool->objectSize * pool->capacity) {
+        free(object);
+        return;
+    }
+
+    if (cache == NULL) {
+        pushPool(pool, object);
+        return;
+    }
+
+    if (cache->count == POOL_CACHE_SIZE) {
+        while (cache->count > POOL_CACHE_SIZE / 2) {
+            pushPool(pool, cache->objects[--cache->count]);
+        }
+    }
+    cache->objects[cache->count++] = object;
+}
+
+//Takes an object off the free stack
+//Returns the object or NULL if the pool is empty
+void *popPool(struct objectPool *pool) {
+    unsigned long long head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    unsigned long long newHead;
+    unsigned int index;
+    unsigned int next;
+
+    do {
+        index = head & 0xFFFFFFFFU;
+        if (index == POOL_NONE) {
+            return NULL;
+        }
+        //May read a link another thread is changing, the tag makes that CAS fail
+        next = __atomic_load_n((unsigned int *)(pool->slab + index * pool->objectSize),
+                               __ATOMIC_RELAXED);
+        newHead = (head & ~0xFFFFFFFFULL) | next;
+    } while (!__atomic_compare_exchange_n(&pool->head, &head, newHead, 1,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+    return pool->slab + index * pool->objectSize;
+}
+
+//Puts an object that came from the slab back on the free stack
+void pushPool(struct objectPool *pool, void *object) {
+    unsigned int index = ((unsigned char *)object - pool->slab) / pool->objectSize;
+    unsigned long long head = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+    unsigned long long newHead;
+    unsigned int next;
+
+    do {
+        next = head & 0xFFFFFFFFU;
+        __atomic_store_n((unsigned int *)object, next, __ATOMIC_RELAXED);
+        newHead = ((head >> 32) + 1) << 32 | index;
+    } while (!__atomic_compare_exchange_n(&pool->head, &head, newHead, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+//Returns the number of objects taken from the heap because the pool was empty
+unsigned long getPoolMallocs(struct objectPool *pool) {
+    return __atomic_load_n(&pool->mallocs, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,39 @@
+#ifndef OBJECT_POOL
+#define OBJECT_POOL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_CACHE_SIZE 64      //Objects a thread keeps for itself
+#define POOL_ALIGN 8            //Objects are padded to a multiple of this
+#define POOL_NONE 0xFFFFFFFFU   //Index marking the end of the free stack
+
+//Struct for a fixed number of same sized objects carved from one allocation
+//Free objects form a lock-free stack linked by index through their first bytes
+//The head holds a tag in its top half that changes on every push so a stale pop fails
+struct objectPool {
+    unsigned char *slab;
+    size_t objectSize;
+    unsigned int capacity;
+    volatile unsigned long long head;   //Tag << 32 | index of the first free object
+    volatile unsigned long mallocs;     //Gets that found the pool empty, served from the heap
+                                        //except in the static build where they fail
+};
+
+//Struct for objects a single thread holds so most gets and puts touch no shared state
+struct poolCache {
+    void *objects[POOL_CACHE_SIZE];
+    unsigned int count;
+};
+
+int initPool(struct objectPool *pool, size_t objectSize, unsigned int capacity);
+void destroyPool(struct objectPool *pool);
+void initPoolCache(struct poolCache *cache);
+void *poolGet(struct objectPool *pool, struct poolCache *cache);
+void poolPut(struct objectPool *pool, struct poolCache *cache, void *object);
+void *popPool(struct objectPool *pool);
+void pushPool(struct objectPool *pool, void *object);
+unsigned long getPoolMallocs(struct objectPool *pool);
+
+#endif
@@ -0,0 +1,141 @@
+#include "radiotap_cache.h"
+
+//Initialises the cache to hold no layouts
+void initRadiotapCache(struct radiotapCache *cache) {
+    memset(cache, 0, sizeof(*cache));
+}
+
+//Reads the channel frequency and RSSI of the frame, using the offsets cached
+//for its layout and only walking the header for layouts not seen recently.
+//RSSI is negated dBm or dB as readPacket has always used it.
+//Fields missing from the frame are left as 0
+void readRadiotapFields(struct radiotapCache *cache, const unsigned char *packet,
+        unsigned int caplen, unsigned short *frequency, unsigned char *rssi) {
+
+    struct radiotapLayout *layout = NULL;
+    struct radiotapLayout found;
+    unsigned int length;
+
+    *frequency = 0;
+    *rssi = 0;
+    if (caplen < sizeof(struct ieee80211_radiotap_header)) {
+        return;
+    }
+    length = le16toh(((const struct ieee80211_radiotap_header *)packet)->it_len);
+    if (length > caplen) {
+        return;
+    }
+
+    if (matchLayout(&cache->layouts[cache->last], packet, length)) {
+        layout = &cache->layouts[cache->last];
+    } else {
+        for (unsigned int i = 0; i < RADIOTAP_CACHE_SIZE; i++) {
+            if (matchLayout(&cache->layouts[i], packet, length)) {
+                layout = &cache->layouts[i];
+                cache->last = i;
+                break;
+            }
+        }
+    }
+
+    if (layout == NULL) {   //Unseen layout so fall back to the generic iterator
+        cache->misses++;
+        if (findLayout(&found, packet, caplen, frequency, rssi) == 0) {
+            cache->layouts[cache->next] = found;
+            cache->last = cache->next;
+            cache->next = (cache->next + 1) % RADIOTAP_CACHE_SIZE;
+        }
+        return;
+    }
+
+    if (layout->channelOffset >= 0) {
+        *frequency = packet[layout->channelOffset] | packet[layout->channelOffset + 1] << 8;
+    }
+    if (layout->signalOffset >= 0) {
+        *rssi = layout->signalIsDbm ? 256 - packet[layout->signalOffset] :
+                packet[layout->signalOffset];
+    }
+}
+
+//Checks if the frame's radiotap header has the given layout
+//Returns non-zero if it does; otherwise 0
+int matchLayout(struct radiotapLayout *layout, const unsigned char *packet,
+        unsigned int length) {
+
+    const unsigned char *word = packet + offsetof(struct ieee80211_radiotap_header, it_present);
+    uint32_t present;
+
+    if (layout->numPresent == 0 || layout->length != length ||
+        length < offsetof(struct ieee80211_radiotap_header, it_present) +
+                 layout->numPresent * sizeof(present)) {
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < layout->numPresent; i++) {
+        memcpy(&present, word + i * sizeof(present), sizeof(present));
+        if (le32toh(present) != layout->present[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+//Walks the radiotap header with the generic iterator to read the fields and
+//work out their offsets for the layout
+//Returns 0 if the layout can be cached; otherwise non-zero
+int findLayout(struct radiotapLayout *layout, const unsigned char *packet, unsigned int caplen,
+        unsigned short *frequency, unsigned char *rssi) {
+
+    struct ieee80211_radiotap_iterator iterator;
+    struct ieee80211_radiotap_header *radiotapHeader = (struct ieee80211_radiotap_header *)packet;
+    const unsigned char *word = packet + offsetof(struct ieee80211_radiotap_header, it_present);
+    uint32_t present;
+    int cacheable = 1;
+    int retval;
+
+    memset(layout, 0, sizeof(*layout));
+    layout->length = le16toh(radiotapHeader->it_len);
+    layout->channelOffset = -1;
+    layout->signalOffset = -1;
+
+    retval = ieee80211_radiotap_iterator_init(&iterator, radiotapHeader, caplen, NULL);
+
+    while (!retval) {
+        retval = ieee80211_radiotap_iterator_next(&iterator);
+        if (retval) {
+            continue;
+        }
+
+        if (iterator.this_arg_index == IEEE80211_RADIOTAP_CHANNEL) {
+            *frequency = iterator.this_arg[0] | iterator.this_arg[1] << 8;
+            layout->channelOffset = iterator.this_arg - packet;
+        } else if (iterator.this_arg_index == IEEE80211_RADIOTAP_DBM_ANTSIGNAL) {
+            *rssi = 256 - *(iterator.this_arg);
+            layout->signalOffset = iterator.this_arg - packet;
+            layout->signalIsDbm = 1;
+            break;
+        } else if (iterator.this_arg_index == IEEE80211_RADIOTAP_DB_ANTSIGNAL) {
+            *rssi = *(iterator.this_arg);
+            layout->signalOffset = iterator.this_arg - packet;
+            break;
+        }
+    }
+
+    //Copy the present words, which end at the first without the extension bit
+    do {
+        if (layout->numPresent == RADIOTAP_MAX_PRESENT ||
+            word + sizeof(present) > packet + layout->length) {
+            return 1;
+        }
+        memcpy(&present, word, sizeof(present));
+        present = le32toh(present);
+        layout->present[layout->numPresent++] = present;
+        word += sizeof(present);
+
+        if (present & (1 << IEEE80211_RADIOTAP_VENDOR_NAMESPACE)) {
+            cacheable = 0;  //Vendor data is sized by the frame, not the layout
+        }
+    } while (present & (1U << IEEE80211_RADIOTAP_EXT));
+
+    return !cacheable;
+}
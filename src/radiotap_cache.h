@@ -0,0 +1,45 @@
+#ifndef RADIOTAP_CACHE
+#define RADIOTAP_CACHE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+#include <endian.h>
+
+#include "radiotap.h"
+#include "radiotap_iter.h"
+
+#define RADIOTAP_CACHE_SIZE 8       //Layouts remembered per capture thread
+#define RADIOTAP_MAX_PRESENT 4      //Present words a cached layout can have
+
+//Struct for where the fields readPacket needs sit in one radiotap layout
+//A layout is fixed by its present words, unless it has a vendor namespace
+//whose length is only known from the frame
+struct radiotapLayout {
+    uint32_t present[RADIOTAP_MAX_PRESENT];
+    unsigned short numPresent;      //0 if the slot is empty
+    unsigned short length;          //it_len
+    short channelOffset;            //-1 if the layout has no channel
+    short signalOffset;             //-1 if the layout has no signal
+    char signalIsDbm;               //dBm signal rather than dB above an arbitrary point
+};
+
+//Struct for the layouts seen most recently by one capture thread
+struct radiotapCache {
+    struct radiotapLayout layouts[RADIOTAP_CACHE_SIZE];
+    unsigned int last;              //Layout that matched the previous frame
+    unsigned int next;              //Slot the next new layout replaces
+    unsigned long misses;           //Frames that needed the generic iterator
+};
+
+void initRadiotapCache(struct radiotapCache *cache);
+void readRadiotapFields(struct radiotapCache *cache, const unsigned char *packet,
+        unsigned int caplen, unsigned short *frequency, unsigned char *rssi);
+int matchLayout(struct radiotapLayout *layout, const unsigned char *packet,
+        unsigned int length);
+int findLayout(struct radiotapLayout *layout, const unsigned char *packet, unsigned int caplen,
+        unsigned short *frequency, unsigned char *rssi);
+
+#endif
@@ -0,0 +1,222 @@
+#include "ring_queue.h"
+
+//Initialises the given queue with room for capacity items rounded up to a power of 2
+//Items dropped by the overflow policy are released with freeData if it is given
+//Returns 0 on success; otherwise -1
+int initQueue(struct ringQueue *queue, unsigned long capacity, enum overflowPolicy policy,
+        void (*freeData)(void *data)) {
+
+    unsigned long size = 2;
+
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    memset(queue, 0, sizeof(*queue));
+    queue->mask = size - 1;
+    queue->policy = policy;
+    queue->freeData = freeData;
+
+    queue->cells = malloc(sizeof(*queue->cells) * size);
+    if (queue->cells == NULL) {
+        fprintf(stderr, "Error allocating queue.\n");
+        return -1;
+    }
+    for (unsigned long i = 0; i < size; i++) {
+        queue->cells[i].sequence = i;
+        queue->cells[i].data = NULL;
+    }
+
+    queue->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (queue->eventFd < 0) {
+        fprintf(stderr, "Error creating queue eventfd: %s\n", strerror(errno));
+        free(queue->cells);
+        queue->cells = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+//Frees the queue and releases everything still in it
+//No other thread may be using the queue
+void destroyQueue(struct ringQueue *queue) {
+    void *data;
+
+    if (queue->cells == NULL) {
+        return;
+    }
+
+    while ((data = dequeue(queue)) != NULL) {
+        if (queue->freeData != NULL) {
+            queue->freeData(data);
+        }
+    }
+
+    close(queue->eventFd);
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+//Adds data to the tail of the queue, applying the overflow policy if it is full
+//Returns 0 if nothing was dropped; otherwise 1
+int enqueue(struct ringQueue *queue, void *data) {
+    void *dropped;
+    unsigned int wanted;
+    int retval = 0;
+
+    while (tryEnqueue(queue, data)) {
+        if (queue->policy == QUEUE_DROP_NEWEST) {
+            dropped = data;
+        } else {    //Make room by taking the oldest item, another thread may beat us to it
+            dropped = dequeue(queue);
+        }
+
+        if (dropped != NULL) {
+            __atomic_add_fetch(&queue->dropped, 1, __ATOMIC_RELAXED);
+            if (queue->freeData != NULL) {
+                queue->freeData(dropped);
+            }
+            retval = 1;
+            if (dropped == data) {
+                return retval;
+            }
+        }
+    }
+
+    //Only wake the consumer once it has enough to do
+    wanted = __atomic_load_n(&queue->wanted, __ATOMIC_SEQ_CST);
+    if (wanted && getQueueSize(queue) >= wanted &&
+            __atomic_exchange_n(&queue->wanted, 0, __ATOMIC_SEQ_CST)) {
+        wakeQueue(queue);
+    }
+
+    return retval;
+}
+
+//Adds data to the tail of the queue if there is room
+//Returns 0 on success; otherwise -1 if the queue is full
+int tryEnqueue(struct ringQueue *queue, void *data) {
+    struct queueCell *cell;
+    unsigned long pos = __atomic_load_n(&queue->enqueuePos, __ATOMIC_RELAXED);
+    unsigned long sequence;
+    long diff;
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        diff = (long)sequence - (long)pos;
+        if (diff == 0) {    //Slot is free, try to claim it
+            if (__atomic_compare_exchange_n(&queue->enqueuePos, &pos, pos + 1, 1,
+                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {  //Slot still holds an item from a lap ago
+            return -1;
+        } else {    //Another producer claimed it first
+            pos = __atomic_load_n(&queue->enqueuePos, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->data = data;
+    __atomic_store_n(&cell->sequence, pos + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+//Removes the item at the head of the queue
+//Returns the item or NULL if the queue is empty
+void *dequeue(struct ringQueue *queue) {
+    struct queueCell *cell;
+    unsigned long pos = __atomic_load_n(&queue->dequeuePos, __ATOMIC_RELAXED);
+    unsigned long sequence;
+    long diff;
+    void *data;
+
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        sequence = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE);
+        diff = (long)sequence - (long)(pos + 1);
+        if (diff == 0) {    //Slot holds an item, try to take it
+            if (__atomic_compare_exchange_n(&queue->dequeuePos, &pos, pos + 1, 1,
+                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {  //Slot hasn't been filled yet
+            return NULL;
+        } else {    //Another consumer took it first
+            pos = __atomic_load_n(&queue->dequeuePos, __ATOMIC_RELAXED);
+        }
+    }
+
+    data = cell->data;
+    __atomic_store_n(&cell->sequence, pos + queue->mask + 1, __ATOMIC_RELEASE);
+    return data;
+}
+
+//Removes up to max items from the head of the queue into data
+//Returns the number of items removed
+unsigned int dequeueBatch(struct ringQueue *queue, void **data, unsigned int max) {
+    unsigned int num = 0;
+
+    while (num < max && (data[num] = dequeue(queue)) != NULL) {
+        num++;
+    }
+
+    return num;
+}
+
+//Returns the number of items in the queue, including any still being written
+unsigned long getQueueSize(struct ringQueue *queue) {
+    unsigned long head = __atomic_load_n(&queue->dequeuePos, __ATOMIC_SEQ_CST);
+    unsigned long tail = __atomic_load_n(&queue->enqueuePos, __ATOMIC_SEQ_CST);
+
+    return tail > head ? tail - head : 0;
+}
+
+//Returns the number of items lost to the overflow policy
+unsigned long getQueueDropped(struct ringQueue *queue) {
+    return __atomic_load_n(&queue->dropped, __ATOMIC_RELAXED);
+}
+
+//Blocks until the queue holds at least count items, timeout milliseconds pass,
+//a signal arrives or wakeQueue is called. A negative timeout waits forever.
+//Returns the number of items in the queue
+unsigned long waitQueue(struct ringQueue *queue, unsigned int count, int timeout) {
+    struct pollfd pfd;
+    unsigned long long value;
+    unsigned long size = getQueueSize(queue);
+
+    if (size >= count) {
+        return size;
+    }
+
+    //Tell producers what we want, then check again in case they just missed it
+    __atomic_store_n(&queue->wanted, count, __ATOMIC_SEQ_CST);
+    size = getQueueSize(queue);
+    if (size < count) {
+        pfd.fd = queue->eventFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeout) < 0 && errno != EINTR) {
+            fprintf(stderr, "Error waiting on queue: %s\n", strerror(errno));
+        }
+    }
+    __atomic_store_n(&queue->wanted, 0, __ATOMIC_SEQ_CST);
+
+    //Clear the eventfd so the next wait blocks
+    if (read(queue->eventFd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        fprintf(stderr, "Error reading queue eventfd: %s\n", strerror(errno));
+    }
+
+    return getQueueSize(queue);
+}
+
+//Wakes a consumer blocked in waitQueue
+//Safe to call from a signal handler
+void wakeQueue(struct ringQueue *queue) {
+    unsigned long long value = 1;
+
+    if (write(queue->eventFd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        fprintf(stderr, "Error signalling queue eventfd.\n");
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef RING_QUEUE
+#define RING_QUEUE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#define QUEUE_CACHE_LINE 64
+
+//What to do when a producer finds the queue full
+enum overflowPolicy {QUEUE_DROP_NEWEST, QUEUE_DROP_OLDEST};
+
+//Struct for a single slot in the queue
+struct queueCell {
+    volatile unsigned long sequence;    //Tells producers and consumers whose turn the slot is
+    void *data;
+};
+
+//Struct for a bounded lock-free queue with any number of producers and consumers
+//Positions are kept on separate cache lines so producers and consumers don't share one
+struct ringQueue {
+    struct queueCell *cells;
+    unsigned long mask;         //Capacity - 1, capacity is a power of 2
+    enum overflowPolicy policy;
+    void (*freeData)(void *data);       //Frees items the queue drops or still holds when destroyed
+    int eventFd;                //Signalled to wake a waiting consumer
+    volatile unsigned long dropped;     //Items lost to the overflow policy
+    volatile unsigned int wanted;       //Items a waiting consumer wants, 0 if not waiting
+    char pad0[QUEUE_CACHE_LINE];
+    volatile unsigned long enqueuePos;
+    char pad1[QUEUE_CACHE_LINE];
+    volatile unsigned long dequeuePos;
+    char pad2[QUEUE_CACHE_LINE];
+};
+
+int initQueue(struct ringQueue *queue, unsigned long capacity, enum overflowPolicy policy,
+        void (*freeData)(void *data));
+void destroyQueue(struct ringQueue *queue);
+int enqueue(struct ringQueue *queue, void *data);
+int tryEnqueue(struct ringQueue *queue, void *data);
+void *dequeue(struct ringQueue *queue);
+unsigned int dequeueBatch(struct ringQueue *queue, void **data, unsigned int max);
+unsigned long getQueueSize(struct ringQueue *queue);
+unsigned long getQueueDropped(struct ringQueue *queue);
+unsigned long waitQueue(struct ringQueue *queue, unsigned int count, int timeout);
+void wakeQueue(struct ringQueue *queue);
+
+#endif
@@ -0,0 +1,153 @@
+#include "rssi_average.h"
+
+//Initialises the given average to hold no readings
+void initAverage(struct rssiAverage *average) {
+    average->head = 0;
+    average->size = 0;
+    average->sum = 0;
+    average->sumSquares = 0;
+}
+
+//Adds a reading to the ring, replacing the oldest reading if it is full
+//The sorted copy is kept up to date with a binary search and a short move
+void addReading(struct rssiAverage *average, time_t now, unsigned char rssi) {
+    struct rssiSample *sample;
+    unsigned int position;
+
+    expireReadings(average, now);
+
+    if (average->size == AVGNUM) {  //Full so drop the oldest reading
+        removeOldest(average);
+    }
+
+    sample = &average->samples[(average->head + average->size) % AVGNUM];
+    sample->timestamp = (unsigned int)now;
+    sample->rssi = rssi;
+    average->sum += rssi;
+    average->sumSquares += rssi * rssi;
+
+    //Insert after any equal readings
+    position = findSorted(average, rssi);
+    while (position < average->size && average->sorted[position] == rssi) {
+        position++;
+    }
+    memmove(&average->sorted[position + 1], &average->sorted[position], average->size - position);
+    average->sorted[position] = rssi;
+    average->size++;
+}
+
+//Removes readings older than AVGTIMEOUT seconds from the head of the ring
+void expireReadings(struct rssiAverage *average, time_t now) {
+    //Chronological order so stop at the first reading that is new enough
+    while (average->size > 0 &&
+           (unsigned int)now - average->samples[average->head].timestamp > AVGTIMEOUT) {
+
+        removeOldest(average);
+    }
+}
+
+//Removes the oldest reading from the ring, the sums and the sorted copy
+void removeOldest(struct rssiAverage *average) {
+    unsigned char rssi = average->samples[average->head].rssi;
+    unsigned int position = findSorted(average, rssi);
+
+    average->sum -= rssi;
+    average->sumSquares -= rssi * rssi;
+    average->head = (average->head + 1) % AVGNUM;
+    average->size--;
+
+    memmove(&average->sorted[position], &average->sorted[position + 1], average->size - position);
+}
+
+//Binary searches the sorted readings
+//Returns the index of the first reading not less than rssi
+unsigned int findSorted(struct rssiAverage *average, unsigned char rssi) {
+    unsigned int low = 0;
+    unsigned int high = average->size;
+    unsigned int middle;
+
+    while (low < high) {
+        middle = (low + high) / 2;
+        if (average->sorted[middle] < rssi) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+//Returns the mean of the readings in the ring or 0 if it is empty
+double getAverage(struct rssiAverage *average) {
+    if (average->size == 0) {
+        return 0.0;
+    }
+    return (double)average->sum / average->size;
+}
+
+//Returns the median of the readings in the ring or 0 if it is empty
+double getMedian(struct rssiAverage *average) {
+    unsigned int middle = average->size / 2;
+
+    if (average->size == 0) {
+        return 0.0;
+    } else if (average->size % 2) {
+        return average->sorted[middle];
+    }
+    return (average->sorted[middle - 1] + average->sorted[middle]) / 2.0;
+}
+
+//Returns the mean of the readings left after dropping 1/AVGTRIM of them from
+//each end, which ignores the occasional reflected or obstructed frame
+double getTrimmedMean(struct rssiAverage *average) {
+    unsigned int trim = average->size / AVGTRIM;
+    unsigned int sum = 0;
+
+    if (average->size == 0) {
+        return 0.0;
+    }
+
+    for (unsigned int i = trim; i < average->size - trim; i++) {
+        sum += average->sorted[i];
+    }
+    return (double)sum / (average->size - 2 * trim);
+}
+
+//Returns the sample standard deviation of the readings or 0 if there are
+//fewer than two
+double getDeviation(struct rssiAverage *average) {
+    double variance;
+
+    if (average->size < 2) {
+        return 0.0;
+    }
+
+    variance = (average->sumSquares - (double)average->sum * average->sum / average->size) /
+               (average->size - 1);
+    return variance > 0.0 ? sqrt(variance) : 0.0;
+}
+
+//Returns the RSSI of the device by the given estimator
+double getEstimate(struct rssiAverage *average, enum rssiEstimator estimator) {
+    if (estimator == ESTIMATE_MEDIAN) {
+        return getMedian(average);
+    } else if (estimator == ESTIMATE_TRIMMED) {
+        return getTrimmedMean(average);
+    }
+    return getAverage(average);
+}
+
+//Reads an estimator name: mean, median or trimmed
+//Returns 0 on success; otherwise non-zero
+int parseEstimator(const char *name, enum rssiEstimator *estimator) {
+    if (strcmp(name, "mean") == 0) {
+        *estimator = ESTIMATE_MEAN;
+    } else if (strcmp(name, "median") == 0) {
+        *estimator = ESTIMATE_MEDIAN;
+    } else if (strcmp(name, "trimmed") == 0) {
+        *estimator = ESTIMATE_TRIMMED;
+    } else {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef RSSI_AVERAGE
+#define RSSI_AVERAGE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define AVGTIMEOUT 300
+#ifndef AVGNUM
+#define AVGNUM 32               //Readings kept per device, the static build may lower it
+#endif
+#define AVGTRIM 4               //1/AVGTRIM of the readings are dropped from each end of a trimmed mean
+
+//How the readings of a device are turned into one RSSI
+enum rssiEstimator {ESTIMATE_MEAN, ESTIMATE_MEDIAN, ESTIMATE_TRIMMED};
+
+//Struct for a single timestamped rssi reading
+struct rssiSample {
+    unsigned int timestamp;
+    unsigned char rssi;
+};
+
+//Struct for a fixed size ring of readings from one device with running sums
+//The same readings are also kept sorted for the median and trimmed mean
+struct rssiAverage {
+    struct rssiSample samples[AVGNUM];
+    unsigned char sorted[AVGNUM];
+    unsigned short head;    //Index of the oldest reading
+    unsigned short size;
+    unsigned int sum;
+    unsigned int sumSquares;
+};
+
+void initAverage(struct rssiAverage *average);
+void addReading(struct rssiAverage *average, time_t now, unsigned char rssi);
+void expireReadings(struct rssiAverage *average, time_t now);
+void removeOldest(struct rssiAverage *average);
+unsigned int findSorted(struct rssiAverage *average, unsigned char rssi);
+double getAverage(struct rssiAverage *average);
+double getMedian(struct rssiAverage *average);
+double getTrimmedMean(struct rssiAverage *average);
+double getDeviation(struct rssiAverage *average);
+double getEstimate(struct rssiAverage *average, enum rssiEstimator estimator);
+int parseEstimator(const char *name, enum rssiEstimator *estimator);
+
+#endif
@@ -0,0 +1,181 @@
+#include "slab_list.h"
+
+//Initialises the given slab to hand out elements of elementSize
+void initListSlab(struct listSlab *slab, size_t elementSize) {
+    //Free elements hold a pointer to the next one
+    if (elementSize < sizeof(void *)) {
+        elementSize = sizeof(void *);
+    }
+    slab->elementSize = (elementSize + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    slab->freeElements = NULL;
+    slab->chunks = NULL;
+    slab->chunkUsed = SLAB_CHUNK_SIZE;
+    slab->inUse = 0;
+}
+
+//Frees every chunk of the slab, whether or not its elements are still in use
+void destroyListSlab(struct listSlab *slab) {
+    void *chunk;
+
+    while (slab->chunks != NULL) {
+        chunk = slab->chunks;
+        slab->chunks = *(void **)chunk;
+        free(chunk);
+    }
+    slab->freeElements = NULL;
+    slab->chunkUsed = SLAB_CHUNK_SIZE;
+    slab->inUse = 0;
+}
+
+//Takes an element from the slab, making a new chunk if none are free
+//Returns the element or NULL if there is no memory
+void *slabAlloc(struct listSlab *slab) {
+    void *element;
+
+    if (slab->freeElements != NULL) {
+        element = slab->freeElements;
+        slab->freeElements = *(void **)element;
+    } else {
+        if (slab->chunkUsed == SLAB_CHUNK_SIZE) {
+            //Chunks start with the link to the previous one, padded like an element
+            void *chunk = malloc(slab->elementSize * (SLAB_CHUNK_SIZE + 1));
+            if (chunk == NULL) {
+                fprintf(stderr, "Error allocating list slab.\n");
+                return NULL;
+            }
+            *(void **)chunk = slab->chunks;
+            slab->chunks = chunk;
+            slab->chunkUsed = 0;
+        }
+        slab->chunkUsed++;
+        element = (char *)slab->chunks + slab->elementSize * slab->chunkUsed;
+    }
+
+    slab->inUse++;
+    return element;
+}
+
+//Returns an element to the slab for reuse
+void slabFree(struct listSlab *slab, void *element) {
+    if (element == NULL) {
+        return;
+    }
+    *(void **)element = slab->freeElements;
+    slab->freeElements = element;
+    slab->inUse--;
+}
+
+//Initialises the given list of elements from slab with their links at linkOffset
+//A mutex is only created if useLock is set
+void initSlabList(struct slabList *list, struct listSlab *slab, size_t linkOffset,
+        unsigned char useLock) {
+
+    list->head = NULL;
+    list->tail = NULL;
+    list->size = 0;
+    list->slab = slab;
+    list->linkOffset = linkOffset;
+    list->mutex = NULL;
+
+    if (useLock) {
+        list->mutex = malloc(sizeof(*list->mutex));
+        if (list->mutex == NULL || pthread_mutex_init(list->mutex, NULL)) {
+            fprintf(stderr, "Error creating list mutex.\n");
+            free(list->mutex);
+            list->mutex = NULL;
+        }
+    }
+}
+
+//Removes all elements and destroys the given list
+void destroySlabList(struct slabList *list, unsigned char deleteData) {
+    lockSlabList(list);
+
+    //Remove all contents
+    while (list->size > 0) {
+        removeFromHeadSlabList(list, LIST_HAVE_LOCK, deleteData);
+    }
+
+    unlockSlabList(list);
+
+    if (list->mutex != NULL) {
+        if (pthread_mutex_destroy(list->mutex)) {
+            fprintf(stderr, "Error destroying list mutex.\n");
+        }
+        free(list->mutex);
+        list->mutex = NULL;
+    }
+}
+
+//Acquires the list's mutex if it has one
+void lockSlabList(struct slabList *list) {
+    if (list->mutex != NULL && pthread_mutex_lock(list->mutex)) {
+        fprintf(stderr, "Error acquiring list mutex.\n");
+    }
+}
+
+//Releases the list's mutex if it has one
+void unlockSlabList(struct slabList *list) {
+    if (list->mutex != NULL && pthread_mutex_unlock(list->mutex)) {
+        fprintf(stderr, "Error releasing list mutex.\n");
+    }
+}
+
+//Adds the element with the given links to the tail of the given list
+void addToTailSlabList(struct slabList *list, struct slabLink *link) {
+    lockSlabList(list);
+
+    link->next = NULL;
+    if (list->tail == NULL) {   //List is empty
+        list->head = link;
+        list->tail = link;
+        link->prev = NULL;
+    } else {    //List is not empty
+        list->tail->next = link;
+        link->prev = list->tail;
+        list->tail = link;
+    }
+    list->size++;
+
+    unlockSlabList(list);
+}
+
+//Removes the element at the head of the given list
+void removeFromHeadSlabList(struct slabList *list, unsigned char haveLock, unsigned char deleteData) {
+    if (list->head != NULL) {   //Check for empty list
+        removeSlabNode(list, list->head, haveLock, deleteData);
+    }
+}
+
+//Removes the element with the given links from the given list, returning it
+//to the list's slab if deleteData is set
+void removeSlabNode(struct slabList *list, struct slabLink *link, unsigned char haveLock,
+        unsigned char deleteData) {
+
+    if (link == NULL) {     //Check element exists
+        return;
+    }
+    if (!haveLock) {
+        lockSlabList(list);
+    }
+
+    if (link->prev == NULL) {   //Element is at head of list
+        list->head = link->next;
+    } else {
+        link->prev->next = link->next;
+    }
+    if (link->next == NULL) {   //Element is at tail of list
+        list->tail = link->prev;
+    } else {
+        link->next->prev = link->prev;
+    }
+    list->size--;
+
+    if (deleteData) {
+        slabFree(list->slab, (char *)link - list->linkOffset);
+    }
+
+    if (!haveLock) {
+        unlockSlabList(list);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef SLAB_LIST
+#define SLAB_LIST
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "linked_list.h"
+
+#define SLAB_CHUNK_SIZE 256     //Elements carved from each allocation the slab makes
+
+//Gets the struct holding the given list link
+#define slabListEntryOf(link, type, member) \
+    ((type *)((char *)(link) - offsetof(type, member)))
+
+//Struct for the links of a list, embedded in the element it links
+struct slabLink {
+    struct slabLink *next;
+    struct slabLink *prev;
+};
+
+//Struct for allocating same sized elements from chunks that are kept until
+//the slab is destroyed. Freed elements are reused before a new chunk is made.
+//Not thread safe, so a slab must only be used by one thread at a time.
+struct listSlab {
+    size_t elementSize;
+    void *freeElements;         //Singly linked through the first bytes of each free element
+    void *chunks;               //Singly linked through the first bytes of each chunk
+    unsigned int chunkUsed;     //Elements handed out from the newest chunk
+    unsigned long inUse;
+};
+
+//Struct for a list of elements that hold their own links
+//The mutex is only created for lists that need locking
+struct slabList {
+    struct slabLink *head;
+    struct slabLink *tail;
+    unsigned int size;
+    pthread_mutex_t *mutex;
+    struct listSlab *slab;      //Elements are returned here when their data is deleted
+    size_t linkOffset;          //Offset of the links in each element
+};
+
+void initListSlab(struct listSlab *slab, size_t elementSize);
+void destroyListSlab(struct listSlab *slab);
+void *slabAlloc(struct listSlab *slab);
+void slabFree(struct listSlab *slab, void *element);
+void initSlabList(struct slabList *list, struct listSlab *slab, size_t linkOffset,
+        unsigned char useLock);
+void destroySlabList(struct slabList *list, unsigned char deleteData);
+void lockSlabList(struct slabList *list);
+void unlockSlabList(struct slabList *list);
+void addToTailSlabList(struct slabList *list, struct slabLink *link);
+void removeFromHeadSlabList(struct slabList *list, unsigned char haveLock, unsigned char deleteData);
+void removeSlabNode(struct slabList *list, struct slabLink *link, unsigned char haveLock,
+        unsigned char deleteData);
+
+#endif
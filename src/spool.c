@@ -0,0 +1,126 @@
+#include "spool.h"
+
+//Maps the spool file, creating it or resetting it if it is not a spool of
+//this size, and keeps any readings a previous run left in it
+//Returns 0 on success; otherwise non-zero
+int openSpool(struct spool *spool, const char *path, size_t size) {
+    struct spoolHeader *header;
+    unsigned long long capacity;
+
+    spool->fd = -1;
+    spool->header = NULL;
+    spool->records = NULL;
+
+    capacity = (size - SPOOL_HEADER_SIZE) / sizeof(struct wisnPacket);
+    if (size <= SPOOL_HEADER_SIZE || capacity == 0) {
+        fprintf(stderr, "Spool size too small.\n");
+        return 1;
+    }
+    spool->size = SPOOL_HEADER_SIZE + capacity * sizeof(struct wisnPacket);
+
+    spool->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (spool->fd < 0) {
+        fprintf(stderr, "Error opening spool %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (ftruncate(spool->fd, spool->size) != 0) {
+        fprintf(stderr, "Error sizing spool %s: %s\n", path, strerror(errno));
+        close(spool->fd);
+        spool->fd = -1;
+        return 1;
+    }
+
+    spool->header = mmap(NULL, spool->size, PROT_READ | PROT_WRITE, MAP_SHARED, spool->fd, 0);
+    if (spool->header == MAP_FAILED) {
+        fprintf(stderr, "Error mapping spool %s: %s\n", path, strerror(errno));
+        spool->header = NULL;
+        close(spool->fd);
+        spool->fd = -1;
+        return 1;
+    }
+    spool->records = (struct wisnPacket *)((unsigned char *)spool->header + SPOOL_HEADER_SIZE);
+
+    header = spool->header;
+    if (header->magic != SPOOL_MAGIC || header->version != SPOOL_VERSION ||
+        header->recordSize != sizeof(struct wisnPacket) || header->capacity != capacity ||
+        header->writePos - header->readPos > capacity) {
+
+        //Not a spool this build can read so start it empty
+        memset(header, 0, sizeof(*header));
+        header->magic = SPOOL_MAGIC;
+        header->version = SPOOL_VERSION;
+        header->recordSize = sizeof(struct wisnPacket);
+        header->capacity = capacity;
+    }
+
+    return 0;
+}
+
+//Writes everything in the mapping to disk and unmaps the spool
+void closeSpool(struct spool *spool) {
+    if (spool->header != NULL) {
+        msync(spool->header, spool->size, MS_SYNC);
+        munmap(spool->header, spool->size);
+        spool->header = NULL;
+        spool->records = NULL;
+    }
+    if (spool->fd >= 0) {
+        close(spool->fd);
+        spool->fd = -1;
+    }
+}
+
+//Appends the readings, overwriting the oldest if the spool is full
+void spoolWrite(struct spool *spool, struct wisnPacket **packets, unsigned int num) {
+    struct spoolHeader *header = spool->header;
+
+    for (unsigned int i = 0; i < num; i++) {
+        if (header->writePos - header->readPos == header->capacity) {
+            header->readPos++;
+            header->dropped++;
+        }
+        memcpy(&spool->records[header->writePos % header->capacity], packets[i],
+               sizeof(struct wisnPacket));
+        header->writePos++;
+    }
+}
+
+//Copies up to max of the oldest readings without removing them
+//Returns the number of readings copied
+unsigned int spoolPeek(struct spool *spool, struct wisnPacket *packets, unsigned int max) {
+    struct spoolHeader *header = spool->header;
+    unsigned long long available = header->writePos - header->readPos;
+    unsigned int num = available < max ? available : max;
+
+    for (unsigned int i = 0; i < num; i++) {
+        memcpy(&packets[i], &spool->records[(header->readPos + i) % header->capacity],
+               sizeof(struct wisnPacket));
+    }
+    return num;
+}
+
+//Removes the given number of the oldest readings once they have been sent
+void spoolConsume(struct spool *spool, unsigned int num) {
+    struct spoolHeader *header = spool->header;
+
+    if (num > header->writePos - header->readPos) {
+        num = header->writePos - header->readPos;
+    }
+    header->readPos += num;
+}
+
+//Returns the number of readings in the spool
+unsigned long long getSpoolSize(struct spool *spool) {
+    if (spool->header == NULL) {
+        return 0;
+    }
+    return spool->header->writePos - spool->header->readPos;
+}
+
+//Returns the number of readings overwritten before they could be sent
+unsigned long long getSpoolDropped(struct spool *spool) {
+    if (spool->header == NULL) {
+        return 0;
+    }
+    return spool->header->dropped;
+}
@@ -0,0 +1,50 @@
+#ifndef SPOOL
+#define SPOOL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "wisn_packet.h"
+
+#define SPOOL_MAGIC 0x4C4F4F5053534957ULL  //"WISSPOOL"
+#define SPOOL_VERSION 1
+#define SPOOL_HEADER_SIZE 4096  //Header gets its own page so records stay aligned
+
+//Struct for the start of a spool file, kept up to date in the mapping so a
+//restart carries on from where the last run stopped
+struct spoolHeader {
+    unsigned long long magic;
+    unsigned int version;
+    unsigned int recordSize;
+    unsigned long long capacity;    //Records the file holds
+    volatile unsigned long long readPos;    //Records ever taken out
+    volatile unsigned long long writePos;   //Records ever put in
+    volatile unsigned long long dropped;    //Records overwritten before being sent
+};
+
+//Struct for a size capped file of readings waiting for the broker, used as a
+//circular buffer that overwrites the oldest readings when full
+//Only to be used from one thread
+struct spool {
+    int fd;
+    size_t size;
+    struct spoolHeader *header;
+    struct wisnPacket *records;
+};
+
+int openSpool(struct spool *spool, const char *path, size_t size);
+void closeSpool(struct spool *spool);
+void spoolWrite(struct spool *spool, struct wisnPacket **packets, unsigned int num);
+unsigned int spoolPeek(struct spool *spool, struct wisnPacket *packets, unsigned int max);
+void spoolConsume(struct spool *spool, unsigned int num);
+unsigned long long getSpoolSize(struct spool *spool);
+unsigned long long getSpoolDropped(struct spool *spool);
+
+#endif
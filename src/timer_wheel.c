@@ -0,0 +1,113 @@
+#include "timer_wheel.h"
+
+//Initialises the given wheel to hold no entries
+void initWheel(struct timerWheel *wheel, time_t now) {
+    for (unsigned int i = 0; i < WHEEL_SLOTS; i++) {
+        wheel->slots[i].next = &wheel->slots[i];
+        wheel->slots[i].prev = &wheel->slots[i];
+    }
+    wheel->now = now;
+    wheel->size = 0;
+}
+
+//Adds the entry to expire at the given time, never earlier than the next second
+void addToWheel(struct timerWheel *wheel, struct wheelEntry *entry, time_t expires) {
+    struct wheelEntry *slot;
+
+    if (expires <= wheel->now) {
+        expires = wheel->now + 1;
+    }
+    entry->expires = expires;
+
+    slot = &wheel->slots[expires & (WHEEL_SLOTS - 1)];
+    entry->next = slot;
+    entry->prev = slot->prev;
+    slot->prev->next = entry;
+    slot->prev = entry;
+    wheel->size++;
+}
+
+//Takes the entry off the wheel without expiring it
+void removeFromWheel(struct timerWheel *wheel, struct wheelEntry *entry) {
+    entry->prev->next = entry->next;
+    entry->next->prev = entry->prev;
+    entry->next = NULL;
+    entry->prev = NULL;
+    wheel->size--;
+}
+
+//Moves the wheel on to the given time, handing every entry that has expired
+//to expire after taking it off the wheel. expire may add the entry back.
+//Returns the number of entries expired
+unsigned long advanceWheel(struct timerWheel *wheel, time_t now,
+        void (*expire)(struct wheelEntry *entry, void *arg), void *arg) {
+    struct wheelEntry *slot;
+    struct wheelEntry *entry;
+    struct wheelEntry *next;
+    struct wheelEntry pending;
+    unsigned long expired = 0;
+
+    //A long gap only needs one turn of the wheel
+    if (now - wheel->now > WHEEL_SLOTS) {
+        wheel->now = now - WHEEL_SLOTS;
+    }
+
+    while (wheel->now < now) {
+        wheel->now++;
+        slot = &wheel->slots[wheel->now & (WHEEL_SLOTS - 1)];
+
+        //Detach the due entries first so expire can safely add back to this slot
+        pending.next = &pending;
+        pending.prev = &pending;
+        for (entry = slot->next; entry != slot; entry = next) {
+            next = entry->next;
+            if (entry->expires <= now) {
+                entry->prev->next = entry->next;
+                entry->next->prev = entry->prev;
+                entry->next = &pending;
+                entry->prev = pending.prev;
+                pending.prev->next = entry;
+                pending.prev = entry;
+            }
+        }
+
+        for (entry = pending.next; entry != &pending; entry = next) {
+            next = entry->next;
+            entry->next = NULL;
+            entry->prev = NULL;
+            wheel->size--;
+            expired++;
+            expire(entry, arg);
+        }
+    }
+
+    return expired;
+}
+
+//Finds the entry due soonest. Slots are searched in order from the current time,
+//but a slot can also hold entries a turn or more away, so the search only stops
+//once no later slot can hold anything sooner than the best found so far.
+//Returns the entry or NULL if the wheel is empty
+struct wheelEntry *getNextExpiry(struct timerWheel *wheel) {
+    struct wheelEntry *slot;
+    struct wheelEntry *entry;
+    struct wheelEntry *next = NULL;
+
+    for (time_t i = 1; i <= WHEEL_SLOTS; i++) {
+        //Entries in this slot and later ones expire at now + i or after
+        if (next != NULL && next->expires <= wheel->now + i) {
+            break;
+        }
+
+        slot = &wheel->slots[(wheel->now + i) & (WHEEL_SLOTS - 1)];
+        for (entry = slot->next; entry != slot; entry = entry->next) {
+            if (next == NULL || entry->expires < next->expires) {
+                next = entry;
+                if (entry->expires <= wheel->now + i) {
+                    break;  //Nothing in the slot can be sooner
+                }
+            }
+        }
+    }
+    return next;
+}
@@ -0,0 +1,38 @@
+#ifndef TIMER_WHEEL
+#define TIMER_WHEEL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <time.h>
+
+#define WHEEL_SLOTS 512         //One second per slot, a power of 2, a turn covers the default
+                                //idle timeout so finding the next expiry rarely looks past a slot
+
+//Gets the struct holding the given wheel entry
+#define wheelEntryOf(entry, type, member) \
+    ((type *)((char *)(entry) - offsetof(type, member)))
+
+//Struct for something the wheel expires, embedded in the thing that expires
+struct wheelEntry {
+    struct wheelEntry *next;
+    struct wheelEntry *prev;
+    time_t expires;
+};
+
+//Struct for a hashed timer wheel with one second slots
+//Entries further away than a full turn stay in their slot until their turn comes round
+struct timerWheel {
+    struct wheelEntry slots[WHEEL_SLOTS];   //Circular lists with the slot as the head
+    time_t now;                 //Second the wheel has expired entries up to
+    unsigned long size;
+};
+
+void initWheel(struct timerWheel *wheel, time_t now);
+void addToWheel(struct timerWheel *wheel, struct wheelEntry *entry, time_t expires);
+void removeFromWheel(struct timerWheel *wheel, struct wheelEntry *entry);
+unsigned long advanceWheel(struct timerWheel *wheel, time_t now,
+        void (*expire)(struct wheelEntry *entry, void *arg), void *arg);
+struct wheelEntry *getNextExpiry(struct timerWheel *wheel);
+
+#endif
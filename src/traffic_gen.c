@@ -0,0 +1,165 @@
+#include "traffic_gen.h"
+
+//Channels the generated transmitters are spread over
+static const unsigned short genFrequencies[] = {2412, 2437, 2462, 2417, 2442, 2467, 2422, 2447};
+
+//Fills the config with the default traffic mix
+void initTrafficConfig(struct trafficConfig *config) {
+    config->devices = GEN_DEVICES;
+    config->accessPoints = GEN_ACCESS_POINTS;
+    config->beaconRatio = GEN_BEACON_RATIO;
+    config->dataWeight = GEN_DATA_WEIGHT;
+    config->probeWeight = GEN_PROBE_WEIGHT;
+    config->controlWeight = GEN_CONTROL_WEIGHT;
+    config->rssiMin = GEN_RSSI_MIN;
+    config->rssiMax = GEN_RSSI_MAX;
+    config->rssiSpread = GEN_RSSI_SPREAD;
+    config->framesPerSecond = GEN_FRAMES_PER_SECOND;
+    config->seed = 1;
+}
+
+//Creates the transmitters for the given config, the same seed always gives
+//the same frames
+//Returns 0 on success; otherwise non-zero
+int initGenerator(struct trafficGenerator *generator, struct trafficConfig *config,
+        struct timeval *start) {
+
+    if (config->devices == 0 || config->framesPerSecond == 0 ||
+        config->rssiMin > config->rssiMax) {
+        fprintf(stderr, "Invalid traffic config.\n");
+        return 1;
+    }
+
+    memcpy(&generator->config, config, sizeof(*config));
+    generator->state = 0x9E3779B97F4A7C15ULL ^ config->seed;
+    generator->start = *start;
+    generator->frames = 0;
+    generator->sequence = 0;
+
+    generator->devices = malloc(config->devices * sizeof(*generator->devices));
+    generator->accessPoints = malloc((config->accessPoints + 1) * sizeof(*generator->accessPoints));
+    if (generator->devices == NULL || generator->accessPoints == NULL) {
+        destroyGenerator(generator);
+        return 1;
+    }
+
+    for (unsigned int i = 0; i < config->devices; i++) {
+        randomSource(generator, &generator->devices[i]);
+    }
+    for (unsigned int i = 0; i < config->accessPoints; i++) {
+        randomSource(generator, &generator->accessPoints[i]);
+    }
+
+    return 0;
+}
+
+//Frees the transmitters
+void destroyGenerator(struct trafficGenerator *generator) {
+    free(generator->devices);
+    free(generator->accessPoints);
+    generator->devices = NULL;
+    generator->accessPoints = NULL;
+}
+
+//Writes the next frame into buffer, which must hold GEN_FRAME_SIZE bytes, and
+//fills in its header with a timestamp framesPerSecond after the last
+//Returns the length of the frame
+unsigned int generateFrame(struct trafficGenerator *generator, struct pcap_pkthdr *header,
+        u_char *buffer) {
+
+    struct trafficConfig *config = &generator->config;
+    struct ieee80211_radiotap_header *radiotapHeader = (struct ieee80211_radiotap_header *)buffer;
+    struct ieee80211_header *ieee80211Header = (struct ieee80211_header *)(buffer + GEN_RADIOTAP_LEN);
+    struct generatedSource *source;
+    struct generatedSource *receiver;
+    unsigned long long micros;
+    unsigned short frameControl;
+    unsigned int length = GEN_FRAME_SIZE;
+    double rssi;
+    double pick;
+
+    receiver = &generator->devices[nextRandom(generator) % config->devices];
+    if (config->accessPoints > 0 && randomUniform(generator) < config->beaconRatio) {
+        source = &generator->accessPoints[nextRandom(generator) % config->accessPoints];
+        frameControl = IEEE80211_MANAGEMENT << 2 | 8 << 4;
+    } else {
+        source = &generator->devices[nextRandom(generator) % config->devices];
+        pick = randomUniform(generator) *
+               (config->dataWeight + config->probeWeight + config->controlWeight);
+
+        if (pick < config->dataWeight) {
+            frameControl = IEEE80211_DATA << 2 | 0x100;     //Data to the AP
+        } else if (pick < config->dataWeight + config->probeWeight) {
+            frameControl = IEEE80211_MANAGEMENT << 2 | 4 << 4;
+        } else if (pick < config->dataWeight + config->probeWeight + config->controlWeight / 2) {
+            frameControl = IEEE80211_CONTROL << 2 | 11 << 4;  //RTS
+        } else {
+            frameControl = IEEE80211_CONTROL << 2 | 13 << 4;  //ACK
+            length = GEN_ACK_SIZE;
+        }
+    }
+
+    rssi = source->rssi + randomNormal(generator) * config->rssiSpread;
+    rssi = rssi < -127.0 ? -127.0 : rssi > -1.0 ? -1.0 : rssi;
+
+    memset(buffer, 0, GEN_FRAME_SIZE);
+    radiotapHeader->it_version = 0;
+    radiotapHeader->it_len = GEN_RADIOTAP_LEN;
+    radiotapHeader->it_present = 1 << IEEE80211_RADIOTAP_FLAGS | 1 << IEEE80211_RADIOTAP_RATE |
+                                 1 << IEEE80211_RADIOTAP_CHANNEL |
+                                 1 << IEEE80211_RADIOTAP_DBM_ANTSIGNAL |
+                                 1 << IEEE80211_RADIOTAP_ANTENNA;
+    buffer[9] = 2;  //1 Mbps
+    memcpy(buffer + 10, &source->frequency, sizeof(source->frequency));
+    buffer[12] = 0x80;  //2 GHz channel
+    buffer[14] = (u_char)(signed char)lround(rssi);
+
+    ieee80211Header->frameControl = frameControl;
+    memcpy(ieee80211Header->address1, receiver->mac, ARRAY_SIZE(receiver->mac));
+    if (length == GEN_FRAME_SIZE) {
+        memcpy(ieee80211Header->address2, source->mac, ARRAY_SIZE(source->mac));
+        memcpy(ieee80211Header->address3, receiver->mac, ARRAY_SIZE(receiver->mac));
+        ieee80211Header->sequenceControl = generator->sequence++ << 4;
+    }
+
+    micros = generator->start.tv_usec + generator->frames * 1000000ULL / config->framesPerSecond;
+    header->ts.tv_sec = generator->start.tv_sec + micros / 1000000;
+    header->ts.tv_usec = micros % 1000000;
+    header->caplen = length;
+    header->len = length;
+    generator->frames++;
+
+    return length;
+}
+
+//Returns the next pseudo random number from xorshift64*
+uint64_t nextRandom(struct trafficGenerator *generator) {
+    generator->state ^= generator->state >> 12;
+    generator->state ^= generator->state << 25;
+    generator->state ^= generator->state >> 27;
+    return generator->state * 0x2545F4914F6CDD1DULL;
+}
+
+//Returns a pseudo random number in [0, 1)
+double randomUniform(struct trafficGenerator *generator) {
+    return (nextRandom(generator) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//Returns a pseudo random number from the standard normal distribution
+double randomNormal(struct trafficGenerator *generator) {
+    double u1 = 1.0 - randomUniform(generator);
+    double u2 = randomUniform(generator);
+
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+//Gives the source a random locally administered MAC, mean RSSI and channel
+void randomSource(struct trafficGenerator *generator, struct generatedSource *source) {
+    uint64_t bits = nextRandom(generator);
+
+    memcpy(source->mac, &bits, ARRAY_SIZE(source->mac));
+    source->mac[0] = (source->mac[0] & 0xFC) | 0x02;
+    source->rssi = generator->config.rssiMin +
+                   randomUniform(generator) * (generator->config.rssiMax - generator->config.rssiMin);
+    source->frequency = genFrequencies[nextRandom(generator) % ARRAY_SIZE(genFrequencies)];
+}
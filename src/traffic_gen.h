@@ -0,0 +1,75 @@
+#ifndef TRAFFIC_GEN
+#define TRAFFIC_GEN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+#include <sys/time.h>
+#include <pcap.h>
+
+#include "radiotap.h"
+#include "ieee80211.h"
+#include "wisn_packet.h"
+
+#define GEN_DEVICES 500         //Default transmitters heard
+#define GEN_ACCESS_POINTS 20    //Default beacon senders heard
+#define GEN_BEACON_RATIO 0.3    //Default fraction of frames that are beacons
+#define GEN_DATA_WEIGHT 6.0     //Default weights of the frames that are not beacons
+#define GEN_PROBE_WEIGHT 1.0
+#define GEN_CONTROL_WEIGHT 3.0
+#define GEN_RSSI_MIN -90        //Default range the mean RSSI of each transmitter is drawn from
+#define GEN_RSSI_MAX -40
+#define GEN_RSSI_SPREAD 4.0     //Default standard deviation of RSSI around a transmitter's mean
+#define GEN_FRAMES_PER_SECOND 2000
+#define GEN_RADIOTAP_LEN 16     //Flags, rate, channel, dBm signal and antenna
+#define GEN_FRAME_SIZE (GEN_RADIOTAP_LEN + 24)  //Radiotap plus a header with three addresses
+#define GEN_ACK_SIZE (GEN_RADIOTAP_LEN + 10)    //ACKs only carry a receiver address
+
+//Struct for the make up of the generated traffic
+struct trafficConfig {
+    unsigned int devices;
+    unsigned int accessPoints;
+    double beaconRatio;
+    double dataWeight;          //Data frames sent by a device
+    double probeWeight;         //Probe requests sent by a device
+    double controlWeight;       //RTS frames sent by a device and ACKs sent to one, evenly
+    int rssiMin;
+    int rssiMax;
+    double rssiSpread;
+    unsigned int framesPerSecond;   //Sets the gaps between frame timestamps
+    unsigned int seed;
+};
+
+//Struct for a transmitter the generator makes frames for
+struct generatedSource {
+    unsigned char mac[6];
+    double rssi;                //Mean RSSI in dBm
+    unsigned short frequency;
+};
+
+//Struct for generating a repeatable stream of radiotap frames
+struct trafficGenerator {
+    struct trafficConfig config;
+    uint64_t state;             //xorshift64* state
+    struct generatedSource *devices;
+    struct generatedSource *accessPoints;
+    struct timeval start;       //Timestamp of the first frame
+    unsigned long frames;
+    unsigned short sequence;
+};
+
+void initTrafficConfig(struct trafficConfig *config);
+int initGenerator(struct trafficGenerator *generator, struct trafficConfig *config,
+        struct timeval *start);
+void destroyGenerator(struct trafficGenerator *generator);
+unsigned int generateFrame(struct trafficGenerator *generator, struct pcap_pkthdr *header,
+        u_char *buffer);
+uint64_t nextRandom(struct trafficGenerator *generator);
+double randomUniform(struct trafficGenerator *generator);
+double randomNormal(struct trafficGenerator *generator);
+void randomSource(struct trafficGenerator *generator, struct generatedSource *source);
+
+#endif
@@ -0,0 +1,279 @@
+#include "wifi_control.h"
+
+//Opens the nl80211 and rtnetlink sockets and looks up the nl80211 family
+//Returns 0 on success; otherwise -1
+int openWifiControl(struct wifiControl *control) {
+    control->sequence = 0;
+    control->familyID = 0;
+    control->routeFd = -1;
+
+    if (pthread_mutex_init(&control->mutex, NULL)) {
+        fprintf(stderr, "Error creating wifi control mutex.\n");
+    }
+
+    control->genlFd = openNetlink(NETLINK_GENERIC);
+    if (control->genlFd < 0) {
+        return -1;
+    }
+
+    control->routeFd = openNetlink(NETLINK_ROUTE);
+    if (control->routeFd < 0) {
+        closeWifiControl(control);
+        return -1;
+    }
+
+    if (resolveFamily(control)) {
+        closeWifiControl(control);
+        return -1;
+    }
+
+    return 0;
+}
+
+//Closes both netlink sockets
+void closeWifiControl(struct wifiControl *control) {
+    if (control->genlFd >= 0) {
+        close(control->genlFd);
+        control->genlFd = -1;
+    }
+    if (control->routeFd >= 0) {
+        close(control->routeFd);
+        control->routeFd = -1;
+    }
+}
+
+//Brings the given interface up or down through rtnetlink
+//Returns 0 on success; otherwise -1
+int setInterfaceUp(struct wifiControl *control, const char *device, char up) {
+    unsigned char buffer[NLMSG_SPACE(sizeof(struct ifinfomsg))];
+    struct nlmsghdr *message = (struct nlmsghdr *)buffer;
+    struct ifinfomsg *info;
+
+    memset(buffer, 0, sizeof(buffer));
+    message->nlmsg_len = NLMSG_LENGTH(sizeof(*info));
+    message->nlmsg_type = RTM_NEWLINK;
+    message->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+
+    info = NLMSG_DATA(message);
+    info->ifi_family = AF_UNSPEC;
+    info->ifi_index = if_nametoindex(device);
+    info->ifi_change = IFF_UP;
+    info->ifi_flags = up ? IFF_UP : 0;
+    if (info->ifi_index == 0) {
+        fprintf(stderr, "No network interface with name %s found.\n", device);
+        return -1;
+    }
+
+    return sendRequest(control, control->routeFd, message, NULL, 0);
+}
+
+//Puts the given interface in monitor mode through nl80211
+//The interface must be down
+//Returns 0 on success; otherwise -1
+int setMonitorMode(struct wifiControl *control, const char *device) {
+    unsigned char buffer[128];
+    struct nlmsghdr *message = (struct nlmsghdr *)buffer;
+    struct genlmsghdr *header;
+    unsigned int ifIndex = if_nametoindex(device);
+    unsigned int type = NL80211_IFTYPE_MONITOR;
+
+    if (ifIndex == 0) {
+        fprintf(stderr, "No network interface with name %s found.\n", device);
+        return -1;
+    }
+
+    memset(buffer, 0, sizeof(buffer));
+    message->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    message->nlmsg_type = control->familyID;
+    message->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    header = NLMSG_DATA(message);
+    header->cmd = NL80211_CMD_SET_INTERFACE;
+
+    addAttribute(message, NL80211_ATTR_IFINDEX, &ifIndex, sizeof(ifIndex));
+    addAttribute(message, NL80211_ATTR_IFTYPE, &type, sizeof(type));
+
+    return sendRequest(control, control->genlFd, message, NULL, 0);
+}
+
+//Tunes the given interface to a 2.4 GHz channel through nl80211
+//Returns 0 on success; otherwise -1
+int setWifiChannel(struct wifiControl *control, const char *device, int channel) {
+    unsigned char buffer[128];
+    struct nlmsghdr *message = (struct nlmsghdr *)buffer;
+    struct genlmsghdr *header;
+    unsigned int ifIndex = if_nametoindex(device);
+    unsigned int frequency = channelToFrequency(channel);
+    unsigned int channelType = NL80211_CHAN_NO_HT;
+
+    if (ifIndex == 0) {
+        fprintf(stderr, "No network interface with name %s found.\n", device);
+        return -1;
+    }
+
+    memset(buffer, 0, sizeof(buffer));
+    message->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    message->nlmsg_type = control->familyID;
+    message->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    header = NLMSG_DATA(message);
+    header->cmd = NL80211_CMD_SET_WIPHY;
+
+    addAttribute(message, NL80211_ATTR_IFINDEX, &ifIndex, sizeof(ifIndex));
+    addAttribute(message, NL80211_ATTR_WIPHY_FREQ, &frequency, sizeof(frequency));
+    addAttribute(message, NL80211_ATTR_WIPHY_CHANNEL_TYPE, &channelType, sizeof(channelType));
+
+    return sendRequest(control, control->genlFd, message, NULL, 0);
+}
+
+//Returns the centre frequency in MHz of the given 2.4 GHz channel
+int channelToFrequency(int channel) {
+    if (channel == 14) {
+        return 2484;
+    }
+    return 2407 + channel * 5;
+}
+
+//Opens and binds a netlink socket of the given protocol
+//Returns the socket on success; otherwise -1
+int openNetlink(int protocol) {
+    struct sockaddr_nl addr;
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, protocol);
+
+    if (fd < 0) {
+        fprintf(stderr, "Error creating netlink socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+        fprintf(stderr, "Error binding netlink socket: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+//Appends an attribute to the end of the given message
+void addAttribute(struct nlmsghdr *message, unsigned short type, const void *data,
+        unsigned short length) {
+
+    struct nlattr *attribute = (struct nlattr *)((unsigned char *)message +
+            NLMSG_ALIGN(message->nlmsg_len));
+
+    attribute->nla_type = type;
+    attribute->nla_len = NLA_HDRLEN + length;
+    memcpy((unsigned char *)attribute + NLA_HDRLEN, data, length);
+    message->nlmsg_len = NLMSG_ALIGN(message->nlmsg_len) + NLA_ALIGN(attribute->nla_len);
+}
+
+//Sends the given request and waits for the kernel's acknowledgement
+//If reply is given, the first non-error reply is copied into it
+//Returns 0 on success; otherwise -1
+int sendRequest(struct wifiControl *control, int fd, struct nlmsghdr *message,
+        void *reply, int replySize) {
+
+    unsigned char buffer[NL_BUFFER_SIZE];
+    struct nlmsghdr *response;
+    struct nlmsgerr *error;
+    int length;
+    int retval = -1;
+    char done = 0;
+
+    while (pthread_mutex_lock(&control->mutex)) {
+        fprintf(stderr, "Error acquiring wifi control mutex.\n");
+    }
+
+    message->nlmsg_seq = ++control->sequence;
+
+    if (send(fd, message, message->nlmsg_len, 0) < 0) {
+        fprintf(stderr, "Error sending netlink request: %s\n", strerror(errno));
+        done = 1;
+    }
+
+    while (!done) {
+        length = recv(fd, buffer, sizeof(buffer), 0);
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Error reading netlink reply: %s\n", strerror(errno));
+            break;
+        }
+
+        for (response = (struct nlmsghdr *)buffer; NLMSG_OK(response, length);
+                response = NLMSG_NEXT(response, length)) {
+
+            if (response->nlmsg_seq != message->nlmsg_seq) {
+                continue;   //Late reply to an earlier request
+            }
+
+            if (response->nlmsg_type == NLMSG_ERROR) {
+                error = NLMSG_DATA(response);
+                if (error->error == 0) {
+                    retval = 0;
+                } else {
+                    fprintf(stderr, "Netlink request failed: %s\n", strerror(-error->error));
+                }
+                done = 1;
+                break;
+            } else if (reply != NULL && response->nlmsg_len <= replySize) {
+                memcpy(reply, response, response->nlmsg_len);
+                reply = NULL;
+            }
+        }
+    }
+
+    if (pthread_mutex_unlock(&control->mutex)) {
+        fprintf(stderr, "Error releasing wifi control mutex.\n");
+    }
+
+    return retval;
+}
+
+//Looks up the generic netlink family ID of nl80211
+//Returns 0 on success; otherwise -1
+int resolveFamily(struct wifiControl *control) {
+    unsigned char buffer[128];
+    unsigned char reply[NL_BUFFER_SIZE];
+    struct nlmsghdr *message = (struct nlmsghdr *)buffer;
+    struct nlmsghdr *response = (struct nlmsghdr *)reply;
+    struct genlmsghdr *header;
+    struct nlattr *attribute;
+    int length;
+
+    memset(buffer, 0, sizeof(buffer));
+    memset(reply, 0, sizeof(reply));
+    message->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    message->nlmsg_type = GENL_ID_CTRL;
+    message->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    header = NLMSG_DATA(message);
+    header->cmd = CTRL_CMD_GETFAMILY;
+    header->version = 1;
+
+    addAttribute(message, CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME, strlen(NL80211_GENL_NAME) + 1);
+
+    if (sendRequest(control, control->genlFd, message, reply, sizeof(reply)) ||
+            response->nlmsg_len == 0) {
+        fprintf(stderr, "Error looking up nl80211. Is cfg80211 loaded?\n");
+        return -1;
+    }
+
+    //Walk the attributes of the reply for the family ID
+    attribute = (struct nlattr *)((unsigned char *)NLMSG_DATA(response) + GENL_HDRLEN);
+    length = response->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+    while (length >= NLA_HDRLEN && attribute->nla_len >= NLA_HDRLEN &&
+            attribute->nla_len <= length) {
+
+        if (attribute->nla_type == CTRL_ATTR_FAMILY_ID) {
+            memcpy(&control->familyID, (unsigned char *)attribute + NLA_HDRLEN,
+                   sizeof(control->familyID));
+            return 0;
+        }
+        length -= NLA_ALIGN(attribute->nla_len);
+        attribute = (struct nlattr *)((unsigned char *)attribute + NLA_ALIGN(attribute->nla_len));
+    }
+
+    fprintf(stderr, "Error looking up nl80211 family ID.\n");
+    return -1;
+}
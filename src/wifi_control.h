@@ -0,0 +1,42 @@
+#ifndef WIFI_CONTROL
+#define WIFI_CONTROL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <unistd.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/nl80211.h>
+
+#define NL_BUFFER_SIZE 4096     //Large enough for the family lookup reply
+
+//Struct for persistent netlink sockets used to configure wifi interfaces
+struct wifiControl {
+    int genlFd;                 //Generic netlink socket for nl80211
+    int routeFd;                //rtnetlink socket for link state
+    unsigned short familyID;    //Generic netlink family ID of nl80211
+    unsigned int sequence;
+    pthread_mutex_t mutex;      //Serialises requests from different threads
+};
+
+int openWifiControl(struct wifiControl *control);
+void closeWifiControl(struct wifiControl *control);
+int setInterfaceUp(struct wifiControl *control, const char *device, char up);
+int setMonitorMode(struct wifiControl *control, const char *device);
+int setWifiChannel(struct wifiControl *control, const char *device, int channel);
+int channelToFrequency(int channel);
+int openNetlink(int protocol);
+void addAttribute(struct nlmsghdr *message, unsigned short type, const void *data,
+        unsigned short length);
+int sendRequest(struct wifiControl *control, int fd, struct nlmsghdr *message,
+        void *reply, int replySize);
+int resolveFamily(struct wifiControl *control);
+
+#endif
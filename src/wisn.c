@@ -1,53 +1,136 @@
 #include "wisn.h"
 
-KHASH_MAP_INIT_INT64(pckM, struct linkedList *)
-KHASH_MAP_INIT_INT64(lastM, time_t)
-
 const char *ifplugdCommand = "ifplugd -i %s -k";                //Command to stop ifplugd
 const char *wpaSupCommand = "killall wpa_supplicant";           //Command to stop wpa_supplicant
 const char *ifconfigDownCommand = "ifconfig %s down";           //Command to bring down a network interface
 const char *ifconfigUpCommand = "ifconfig %s up";               //Command to bring up a network interface
 const char *iwconfigChannelCommand = "iwconfig %s channel %d";  //Command to change wifi channel
+const char *iwconfigMonitorCommand = "iwconfig %s mode monitor";//Command to put wifi interface in monitor mode
 
 unsigned int nodeNum;   //Number of this base node
-char *wifiInterface;    //Name of wifi interface
-const char *usage = "Usage: wisn node_num wifi_interface [OPTIONS]\n\n"
+const char *usage = "Usage: wisn node_num wifi_interface[:channels] [OPTIONS]\n\n"
                     "-b broker\tMQTT broker to use\n"
                     "-p port\t\tMQTT port to use\n"
                     "-c channel\tOnly listen on the specified wireless channel\n"
+                    "-i interface[:channels]\n\t\tAlso capture on another interface, optionally "
+                    "limited to a comma\n\t\tseparated list of channels\n"
+                    "-l\t\tCapture using libpcap instead of the memory mapped ring\n"
+                    "-j workers\tCapture each interface on this many threads, sharing frames by\n"
+                    "\t\ttransmitter\n"
+                    "-f filter\tpcap filter expression applied in the kernel\n"
+                    "-s snaplen\tBytes of each frame to capture\n"
+                    "-B ms\t\tBatch readings for up to ms milliseconds per message\n"
+                    "-x\t\tSend readings in the binary wire format\n"
+                    "-X\t\tSend readings in the compact columnar binary format\n"
+                    "-S seconds\tSeconds between statistics messages, 0 to disable\n"
+                    "-D ms\t\tMilliseconds to listen for before choosing the next channel\n"
+                    "-e seconds\tSeconds a device can go unheard before it is forgotten\n"
+                    "-m devices\tMost devices tracked at once\n"
+                    "-w file\t\tFile to keep channel statistics in across restarts\n"
+                    "-d dB\t\tOnly report a device when its average moves by more than dB\n"
+                    "-M seconds\tLongest a device goes unreported when using -d\n"
+                    "-a estimator\tRSSI reported for a device: mean (default), median or trimmed\n"
+                    "-r prefix\tRecord captured frames to rotating pcap files\n"
+                    "-R megabytes\tSize of each recording file\n"
+                    "-o file\t\tReplay frames from a pcap file instead of capturing\n"
+                    "-F\t\tReplay as fast as possible instead of at the recorded pace\n"
+                    "-g frames\tProcess synthetic frames as fast as possible instead of capturing\n"
+                    "-k file\t\tFile readings wait in while the broker is unreachable\n"
+                    "-K megabytes\tSize of the spool file, 0 to keep readings in memory\n"
+                    "-U\t\tTrack every device instead of only those registered with the server\n"
+                    "-L level\tLog level: 0 errors, 1 warnings, 2 info (default), 3 every frame\n"
                     "-v\t\twisn version\n";         //Usage String
 
-pcap_t *pcapHandle;             //Pcap handle for the wifi interface to listen on
-volatile char isPcapOpen;       //Flag to indicate whether pcap handle is open or closed
+struct radio radios[MAX_RADIOS];//Wifi interfaces to capture on
+unsigned int numRadios;         //Number of wifi interfaces in use
+char usePcap;                   //Flag for capturing with libpcap instead of the capture ring
+char *captureFilter;            //pcap filter expression to drop unwanted frames in the kernel
+int captureSnaplen;             //Bytes of each frame to capture
+volatile char isPcapOpen;       //Flag to indicate whether the capture handle is open or closed
+volatile sig_atomic_t stopSignal;   //Signal that asked wisn to stop, 0 if none has
+struct wifiControl wifiControl; //Netlink sockets for configuring the wifi interface
+char useNetlink;                //Flag for configuring the interface with netlink instead of commands
+char *recordPrefix;             //Start of the names of recording files, NULL to not record
+int recordFileSize;             //Megabytes in each recording file
+char *replayFile;               //pcap file to replay instead of capturing, NULL to capture
+char replayFast;                //Flag for replaying without the recorded gaps between frames
+unsigned long generateFrames;   //Synthetic frames to process instead of capturing, 0 to capture
+char isOffline;                 //Flag for frames coming from a file or generator, not an interface
 
-pthread_t channelThread;        //Thread for channel switcher
 pthread_t commsThread;          //Thread for communicating with MQTT broker
-volatile char isChannelThreadRunning;   //Flag for if channels switcher is running
-
-struct linkedList packetList;   //Linked list to queue up packets received over wifi
-khash_t(pckM) *packetMap;       //Hashmap for storing all averaged rssi readings
-khash_t(lastM) *lastSentMap;    //Hashmap for storing timestamp of the last packet sent to server
+pthread_t statsThread;          //Thread for publishing runtime statistics
+char isStatsThreadRunning;      //Flag for if the statistics thread is running
+
+struct ringQueue packetQueue;   //Queue of packets received over wifi waiting to be sent
+struct objectPool packetPool;   //Packets for readings, taken by capture threads and put back by comms
+struct poolCache commsCache;    //Packets the comms thread has put back and not yet returned to the pool
+struct objectPool devicePool;   //State for every tracked device
+struct deviceShard shards[MAX_WORKERS];    //Devices split by transmitter between capture workers
+unsigned int numWorkers;        //Capture threads per interface, each with its own shard
+int idleTimeout;                //Seconds a device can go unheard before it is forgotten
+int maxDevices;                 //Most devices tracked at once
+unsigned int shardDevices;      //Most devices tracked by each shard
+double reportDeadband;          //Change in average needed to report a device, 0 to always report
+int maxSilence;                 //Longest a device goes unreported when its average is steady
+enum rssiEstimator estimator;   //How a device's readings are turned into the RSSI reported
+char useRegistered;             //Flag for only tracking devices registered with the server
+struct macFilter *registeredFilter; //Registered devices sent by the server, NULL to track all
+#ifdef WISN_STATIC
+struct macFilter filterBuffers[2];  //The registered filter and the one the next message is read into
+unsigned long long filterKeys[2][REGISTERED_MAX];
+#endif
+pthread_rwlock_t filterLock;    //Lock for swapping the registered filter under capture threads
 
-unsigned int packetTotals[NUMCHANNELS];
-unsigned int channelIndex;
-volatile char isChannelReady;
 int singleChannel;              //The channel to listen on if set
+int dwellTime;                  //Milliseconds to listen for in each channel slot
+unsigned int nextSlot;          //Source of unique channel slot numbers for all radios
+char *stateFile;                //File the channel rates are kept in across restarts
+time_t nextStateSave;           //When the channel rates are next written to the state file
+pthread_mutex_t stateMutex;     //Mutex for writing the state file
 
 struct mosquitto *mosqConn;     //MQTT connection handle
 char *mqttBroker;               //MQTT broker address
 int mqttPort;                   //MQTT broker port to connect on - default is 1883
 volatile char isMQTTCreated;    //Flag for if MQTTClient has been initialised
 volatile char isMQTTConnected;  //Flag for if connected to MQTT broker
-char MQTTTopic[16];             //Topic for publishing messages
+char MQTTTopic[24];             //Topic for publishing messages
+int batchTime;                  //Milliseconds to collect readings for one batch, 0 to send singly
+char useBinary;                 //Flag for sending readings in the binary wire format
+char useColumnar;               //Flag for sending readings in the columnar binary format
+char statsTopic[24];            //Topic for publishing runtime statistics
+int statsInterval;              //Seconds between statistics messages, 0 to disable
+struct spool spool;             //Readings waiting on disk for the broker to come back
+char useSpool;                  //Flag for if the spool is open
+char *spoolFile;                //File the spool is kept in
+int spoolSize;                  //Megabytes in the spool file, 0 to not spool
+unsigned long published;        //Messages published by the comms thread
+unsigned long publishFailures;  //Publish attempts that failed in the comms thread
 
 int main(int argc, char *argv[]) {
-    unsigned char size;
     //Signal handler for kill/termination
     struct sigaction sa;
+    sigset_t signals;
+    sigset_t oldSignals;
     pthread_attr_t attr;
+    int logLevel = LOG_LEVEL_INFO;
 
     mqttPort = MQTT_PORT;
     mqttBroker = MQTT_BROKER;
+    captureFilter = CAPTURE_FILTER;
+    captureSnaplen = CAPTURE_SNAPLEN;
+    statsInterval = STATS_INTERVAL;
+    dwellTime = DWELL_TIME;
+    stateFile = STATE_FILE;
+    idleTimeout = IDLE_TIMEOUT;
+    maxDevices = MAX_DEVICES;
+    reportDeadband = 0.0;
+    estimator = ESTIMATE_MEAN;
+    useRegistered = 1;
+    numWorkers = 1;
+    maxSilence = MAX_SILENCE;
+    recordFileSize = RECORD_FILE_SIZE;
+    spoolFile = SPOOL_FILE;
+    spoolSize = SPOOL_SIZE;
 
     if (argc > 1) {
         if (strcmp(argv[1], "--help") == 0) {
@@ -64,16 +147,10 @@ int main(int argc, char *argv[]) {
             fprintf(stderr, "Invalid node number.\n");
             return 2;
         }
-        memset(MQTTTopic, 0, ARRAY_SIZE(MQTTTopic));
-        snprintf(MQTTTopic, ARRAY_SIZE(MQTTTopic), "wisn/wisn%03u", nodeNum);
 
-        if (checkInterface(argv[2]) == 0) {
-            fprintf(stderr, "No network interface with name %s found.\n", argv[2]);
+        if (parseRadio(argv[2], &radios[numRadios++])) {
+            fprintf(stderr, "%s", usage);
             return 3;
-        } else {
-            size = sizeof(char) * (strlen(argv[2]) + 1);
-            wifiInterface = calloc(1, size);
-            memcpy(wifiInterface, argv[2], size);
         }
 
         mqttPort = MQTT_PORT;
@@ -88,6 +165,57 @@ int main(int argc, char *argv[]) {
                         state = ARG_BROKER;
                     } else if (strcmp(argv[i], "-c") == 0) {
                         state = ARG_CHANNEL;
+                    } else if (strcmp(argv[i], "-l") == 0) {
+                        usePcap = 1;
+                    } else if (strcmp(argv[i], "-f") == 0) {
+                        state = ARG_FILTER;
+                    } else if (strcmp(argv[i], "-s") == 0) {
+                        state = ARG_SNAPLEN;
+                    } else if (strcmp(argv[i], "-B") == 0) {
+                        state = ARG_BATCH;
+                    } else if (strcmp(argv[i], "-x") == 0) {
+                        useBinary = 1;
+                    } else if (strcmp(argv[i], "-X") == 0) {
+                        useBinary = 1;
+                        useColumnar = 1;
+                    } else if (strcmp(argv[i], "-i") == 0) {
+                        state = ARG_INTERFACE;
+                    } else if (strcmp(argv[i], "-S") == 0) {
+                        state = ARG_STATS;
+                    } else if (strcmp(argv[i], "-L") == 0) {
+                        state = ARG_LOG;
+                    } else if (strcmp(argv[i], "-D") == 0) {
+                        state = ARG_DWELL;
+                    } else if (strcmp(argv[i], "-w") == 0) {
+                        state = ARG_STATE;
+                    } else if (strcmp(argv[i], "-e") == 0) {
+                        state = ARG_IDLE;
+                    } else if (strcmp(argv[i], "-m") == 0) {
+                        state = ARG_DEVICES;
+                    } else if (strcmp(argv[i], "-d") == 0) {
+                        state = ARG_DEADBAND;
+                    } else if (strcmp(argv[i], "-M") == 0) {
+                        state = ARG_SILENCE;
+                    } else if (strcmp(argv[i], "-r") == 0) {
+                        state = ARG_RECORD;
+                    } else if (strcmp(argv[i], "-R") == 0) {
+                        state = ARG_RECORD_SIZE;
+                    } else if (strcmp(argv[i], "-o") == 0) {
+                        state = ARG_REPLAY;
+                    } else if (strcmp(argv[i], "-F") == 0) {
+                        replayFast = 1;
+                    } else if (strcmp(argv[i], "-g") == 0) {
+                        state = ARG_GENERATE;
+                    } else if (strcmp(argv[i], "-k") == 0) {
+                        state = ARG_SPOOL;
+                    } else if (strcmp(argv[i], "-K") == 0) {
+                        state = ARG_SPOOL_SIZE;
+                    } else if (strcmp(argv[i], "-a") == 0) {
+                        state = ARG_ESTIMATOR;
+                    } else if (strcmp(argv[i], "-U") == 0) {
+                        useRegistered = 0;
+                    } else if (strcmp(argv[i], "-j") == 0) {
+                        state = ARG_WORKERS;
                     }
                 } else if (state == ARG_PORT) {
                     mqttPort = strtoul(argv[i], NULL, 10);
@@ -108,6 +236,142 @@ int main(int argc, char *argv[]) {
                         return 5;
                     }
                     state = ARG_NONE;
+                } else if (state == ARG_FILTER) {
+                    captureFilter = argv[i];
+                    state = ARG_NONE;
+                } else if (state == ARG_SNAPLEN) {
+                    captureSnaplen = strtol(argv[i], NULL, 10);
+                    if (captureSnaplen < MIN_SNAPLEN || captureSnaplen > 65535) {
+                        fprintf(stderr, "Invalid snaplen\n");
+                        fprintf(stderr, "%s", usage);
+                        return 6;
+                    }
+                    state = ARG_NONE;
+                } else if (state == ARG_BATCH) {
+                    batchTime = strtol(argv[i], NULL, 10);
+                    if (batchTime < 1 || batchTime > MAX_BATCH_TIME) {
+                        fprintf(stderr, "Invalid batch time\n");
+                        fprintf(stderr, "%s", usage);
+                        return 7;
+                    }
+                    state = ARG_NONE;
+                } else if (state == ARG_INTERFACE) {
+                    if (numRadios == MAX_RADIOS) {
+                        fprintf(stderr, "Too many interfaces\n");
+                        return 8;
+                    }
+                    if (parseRadio(argv[i], &radios[numRadios++])) {
+                        fprintf(stderr, "%s", usage);
+                        return 3;
+                    }
+                    state = ARG_NONE;
+                } else if (state == ARG_STATS) {
+                    statsInterval = strtol(argv[i], NULL, 10);
+                    if (statsInterval < 0) {
+                        fprintf(stderr, "Invalid statistics interval\n");
+                        fprintf(stderr, "%s", usage);
+                        return 10;
+                    }
+                    state = ARG_NONE;
+                } else if (state == ARG_LOG) {
+                    logLevel = strtol(argv[i], NULL, 10);
+                    if (logLevel < LOG_LEVEL_ERROR || logLevel > LOG_LEVEL_DEBUG) {
+                        fprintf(stderr, "Invalid log level\n");
+                        fprintf(stderr, "%s", usage);
+                        return 11;
+                    }
+                    state = ARG_NONE;
+                } else if (state == ARG_DWELL) {
+                    dwellTime = strtol(argv[i], NULL, 10);
+                    if (dwellTime < MIN_DWELL_TIME || dwellTime > MAX_DWELL_TIME) {
+                        fprintf(stderr, "Invalid dwell time\n");
+                        fprintf(stderr, "%s", usage);
+                        return 12;
+                    }
+                    state = ARG_NONE;
+                } else if (state == ARG_STATE) {
+                    stateFile = argv[i];
+                    state = ARG_NONE;
+                } else if (state == ARG_IDLE) {
+                    idleTimeout = strtol(argv[i], NULL, 10);
+                    if (idleTimeout < 1) {
+                        fprintf(stderr, "Invalid idle timeout\n");
+                        fprintf(stderr, "%s", usage);
+                        return 13;
+                    }
+                    state = ARG_NONE;
+                } else if (state == ARG_DEVICES) {
+                    maxDevices = strtol(argv[i], NULL, 10);
+                    if (maxDevices < 1 || maxDevices > DEVICE_LIMIT) {
+                        fprintf(stderr, "Invalid device limit\n");
+                        fprintf(stderr, "%s", usage);
+                        return 14;
+                    }
+                    state = ARG_NONE;
+                } else if (state == ARG_DEADBAND) {
+                    reportDeadband = strtod(argv[i], NULL);
+                    if (!(reportDeadband >= 0.0)) {
+                        fprintf(stderr, "Invalid dead-band\n");
+                        fprintf(stderr, "%s", usage);
+                        return 15;
+                    }
+                    state = ARG_NONE;
+                } else if (state == ARG_SILENCE) {
+                    maxSilence = strtol(argv[i], NULL, 10);
+                    if (maxSilence < 1) {
+                        fprintf(stderr, "Invalid silence timeout\n");
+                        fprintf(stderr, "%s", usage);
+                        return 16;
+                    }
+                    state = ARG_NONE;
+                } else if (state == ARG_RECORD) {
+                    recordPrefix = argv[i];
+                    state = ARG_NONE;
+                } else if (state == ARG_RECORD_SIZE) {
+                    recordFileSize = strtol(argv[i], NULL, 10);
+                    if (recordFileSize < 1) {
+                        fprintf(stderr, "Invalid recording file size\n");
+                        fprintf(stderr, "%s", usage);
+                        return 17;
+                    }
+                    state = ARG_NONE;
+                } else if (state == ARG_REPLAY) {
+                    replayFile = argv[i];
+                    state = ARG_NONE;
+                } else if (state == ARG_GENERATE) {
+                    generateFrames = strtoul(argv[i], NULL, 10);
+                    if (generateFrames < 1) {
+                        fprintf(stderr, "Invalid number of frames\n");
+                        fprintf(stderr, "%s", usage);
+                        return 19;
+                    }
+                    state = ARG_NONE;
+                } else if (state == ARG_SPOOL) {
+                    spoolFile = argv[i];
+                    state = ARG_NONE;
+                } else if (state == ARG_SPOOL_SIZE) {
+                    spoolSize = strtol(argv[i], NULL, 10);
+                    if (spoolSize < 0) {
+                        fprintf(stderr, "Invalid spool size\n");
+                        fprintf(stderr, "%s", usage);
+                        return 20;
+                    }
+                    state = ARG_NONE;
+                } else if (state == ARG_ESTIMATOR) {
+                    if (parseEstimator(argv[i], &estimator)) {
+                        fprintf(stderr, "Invalid estimator\n");
+                        fprintf(stderr, "%s", usage);
+                        return 21;
+                    }
+                    state = ARG_NONE;
+                } else if (state == ARG_WORKERS) {
+                    numWorkers = strtol(argv[i], NULL, 10);
+                    if (numWorkers < 1 || numWorkers > MAX_WORKERS) {
+                        fprintf(stderr, "Invalid number of workers\n");
+                        fprintf(stderr, "%s", usage);
+                        return 22;
+                    }
+                    state = ARG_NONE;
                 }
             }
         }
@@ -117,51 +381,368 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    //Binary readings go to their own topic so the server knows how to read them
+    memset(MQTTTopic, 0, ARRAY_SIZE(MQTTTopic));
+    snprintf(MQTTTopic, ARRAY_SIZE(MQTTTopic), "wisn/wisn%03u%s", nodeNum,
+             useBinary ? WIRE_TOPIC_SUFFIX : "");
+    memset(statsTopic, 0, ARRAY_SIZE(statsTopic));
+    snprintf(statsTopic, ARRAY_SIZE(statsTopic), "wisn/wisn%03u%s", nodeNum, STATS_TOPIC_SUFFIX);
+
+    //A replay or generated traffic only needs a name for the interface
+    isOffline = replayFile != NULL || generateFrames > 0;
+    if (isOffline && numRadios > 1) {
+        fprintf(stderr, "Only one interface can be replayed.\n");
+        return 18;
+    }
+    //Fanout needs a ring socket per worker, and a recording file can only have one writer
+    if (numWorkers > 1 && (isOffline || usePcap || recordPrefix != NULL)) {
+        fprintf(stderr, "Several workers need live capture on the ring without recording.\n");
+        return 22;
+    }
+    for (unsigned int i = 0; i < numRadios && !isOffline; i++) {
+        if (checkInterface(radios[i].interface) == 0) {
+            fprintf(stderr, "No network interface with name %s found.\n", radios[i].interface);
+            return 3;
+        }
+    }
+
+    //A single channel given with -c overrides the first interface's plan
+    if (singleChannel) {
+        radios[0].channels[0] = singleChannel;
+        radios[0].numChannels = 1;
+    }
+
+    initLog(logLevel);
+
+    //Start from the channel rates saved by the last run
+    for (unsigned int i = 0; i < numRadios; i++) {
+        initScheduler(&radios[i].scheduler, radios[i].numChannels);
+    }
+    loadChannelState();
+    if (pthread_mutex_init(&stateMutex, NULL)) {
+        fprintf(stderr, "Error creating state mutex.\n");
+    }
+    nextStateSave = time(NULL) + STATE_SAVE_INTERVAL;
+
     //Setup signal handler
-    sa.sa_handler = cleanup;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stopCapture;
     sigaction(SIGINT, &sa, 0);
     sigaction(SIGTERM, &sa, 0);
 
     isPcapOpen = 0;
-    isChannelThreadRunning = 0;
-    initList(&packetList);
-    memset(packetTotals, 0, ARRAY_SIZE(packetTotals));
-    channelIndex = 0;
-    if (singleChannel) {
-        isChannelReady = 0;
-    } else {
-        isChannelReady = 1;
+    if (initQueue(&packetQueue, PACKET_QUEUE_SIZE, QUEUE_DROP_OLDEST, freePacket)) {
+        return 9;
+    }
+
+    //Everything readPacket allocates comes from pools sized up front
+    shardDevices = (maxDevices + numWorkers - 1) / numWorkers;
+    if (initPool(&packetPool, sizeof(struct wisnPacket), PACKET_POOL_SIZE) ||
+        initPool(&devicePool, sizeof(struct deviceState), shardDevices * numWorkers + 1)) {
+        return 9;
+    }
+    initPoolCache(&commsCache);
+
+    //Readings wait on disk while the broker is unreachable
+    if (spoolSize > 0 && !isOffline) {
+        useSpool = openSpool(&spool, spoolFile, spoolSize * 1024UL * 1024UL) == 0;
+        if (!useSpool) {
+            fprintf(stderr, "Readings will wait in memory while the broker is unreachable.\n");
+        } else if (getSpoolSize(&spool) > 0) {
+            logMessage(LOG_LEVEL_INFO, LOG_CLASS_PUBLISH, "%llu readings left in %s to send.",
+                       getSpoolSize(&spool), spoolFile);
+        }
+    }
+    if (pthread_rwlock_init(&filterLock, NULL)) {
+        fprintf(stderr, "Error creating filter lock.\n");
     }
     isMQTTConnected = 0;
     isMQTTCreated = 0;
     connectToBroker(mqttBroker, nodeNum, mqttPort);
 
-    packetMap = kh_init(pckM);
-    lastSentMap = kh_init(lastM);
+    //Worker i of every radio is given the same transmitters, so they share shard i
+    for (unsigned int i = 0; i < numWorkers; i++) {
+        if (initShard(&shards[i], shardDevices, numRadios > 1, isOffline ? 0 : time(NULL))) {
+            return 9;
+        }
+    }
+    for (unsigned int i = 0; i < numRadios; i++) {
+        radios[i].numWorkers = numWorkers;
+        for (unsigned int j = 0; j < numWorkers; j++) {
+            radios[i].workers[j].shard = &shards[j];
+        }
+    }
+
+    if (replayFile != NULL) {
+        //Frames are read from the file through libpcap and carry their recorded times
+        usePcap = 1;
+        radios[0].pcapHandle = openReplay(replayFile);
+        if (radios[0].pcapHandle == NULL) {
+            cleanup(5);
+        }
+        radios[0].isOpen = 1;
+        isPcapOpen = 1;
+    } else if (generateFrames > 0) {
+        isPcapOpen = 1;
+    } else {
+        for (unsigned int i = 0; i < numRadios; i++) {
+            runCommand(ifplugdCommand, radios[i].interface); //Kill ifplugd since it interferes
+        }
+        runCommand(wpaSupCommand, NULL);  //Kill wpa_supplicant since it interferes
+
+        useNetlink = openWifiControl(&wifiControl) == 0;
+        if (!useNetlink) {
+            fprintf(stderr, "Falling back to wireless tools for interface setup.\n");
+        }
 
-    runCommand(ifplugdCommand, wifiInterface); //Kill ifplugd on wlan0 since it interferes
-    runCommand(wpaSupCommand, NULL);  //Kill wpa_supplicant since it interferes
+        for (unsigned int i = 0; i < numRadios; i++) {
+            if (usePcap) {
+                radios[i].pcapHandle = initialisePcap(&radios[i]);
 
-    pcapHandle = initialisePcap("wlan0");
+                if (radios[i].pcapHandle == NULL) {
+                    cleanup(5);
+                }
+            } else if (initialiseRing(&radios[i])) {
+                cleanup(5);
+            }
+            radios[i].isOpen = 1;
+        }
+    }
 
-    if (pcapHandle == NULL) {
-        cleanup(5);
+    for (unsigned int i = 0; i < numRadios && recordPrefix != NULL; i++) {
+        if (openRecorder(&radios[i].recorder, recordPrefix, radios[i].interface,
+                         recordFileSize * 1024UL * 1024UL, captureSnaplen)) {
+            cleanup(10);
+        }
     }
 
-    //Start channel switcher thread
+    //Signals are only handled on this thread so they interrupt its capture loop straight away
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, &oldSignals);
+
+    //Start channel switcher and capture threads for each interface
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    pthread_create(&channelThread, &attr, channelSwitcher, NULL);
-    pthread_create(&commsThread, &attr, sendToServer, NULL);
-    isChannelThreadRunning  = 1;
+    for (unsigned int i = 0; i < numRadios && !isOffline; i++) {
+        pthread_create(&radios[i].channelThread, &attr, channelSwitcher, &radios[i]);
+        radios[i].isChannelThreadRunning = 1;
+        for (unsigned int j = 0; j < radios[i].numWorkers; j++) {
+            if (i > 0 || j > 0) {   //The first worker of the first interface runs on this thread
+                pthread_create(&radios[i].workers[j].thread, &attr, captureLoop,
+                               &radios[i].workers[j]);
+                radios[i].workers[j].isThreadRunning = 1;
+            }
+        }
+    }
+    if (batchTime) {
+        pthread_create(&commsThread, &attr, sendBatchesToServer, NULL);
+    } else {
+        pthread_create(&commsThread, &attr, sendToServer, NULL);
+    }
+    if (statsInterval) {
+        pthread_create(&statsThread, &attr, publishStats, NULL);
+        isStatsThreadRunning = 1;
+    }
     pthread_attr_destroy(&attr);
+    pthread_sigmask(SIG_SETMASK, &oldSignals, NULL);
+
+    //Anything that opened capture since a signal arrived mustn't keep it running
+    if (stopSignal) {
+        cleanup(stopSignal);
+    }
+
+    logMessage(LOG_LEVEL_INFO, LOG_CLASS_GENERAL, "Finished initialisation.");
+
+    if (replayFile != NULL) {
+        replayCapture(&radios[0]);
+        cleanup(0);
+    } else if (generateFrames > 0) {
+        generateCapture(&radios[0]);
+        cleanup(0);
+    }
+
+    captureLoop(&radios[0].workers[0]);
+
+    //Capture only stops for a signal unless it failed
+    cleanup(stopSignal ? stopSignal : -1);
+}
+
+/* Signal handler for kill/termination. Only stops capture, as little is safe
+ * in a handler; the main thread cleans up once its capture loop returns.
+ */
+void stopCapture(int sig) {
+    stopSignal = sig;
+    isPcapOpen = 0;
+    for (unsigned int i = 0; i < numRadios; i++) {
+        if (radios[i].isOpen && radios[i].pcapHandle != NULL) {
+            pcap_breakloop(radios[i].pcapHandle);
+        }
+    }
+    if (packetQueue.cells != NULL) {
+        wakeQueue(&packetQueue);
+    }
+}
+
+/* Reads an interface name and optional comma separated channel plan such as
+ * wlan1:1,6,11 into the given radio. Without a plan all channels are used.
+ * Returns 0 on success; otherwise non-zero.
+ */
+int parseRadio(char *arg, struct radio *radio) {
+    char *plan = strchr(arg, ':');
+    char *channel;
+    long value;
+
+    memset(radio, 0, sizeof(*radio));
+    for (unsigned int i = 0; i < MAX_WORKERS; i++) {
+        radio->workers[i].radio = radio;
+        radio->workers[i].captureRing.fd = -1;
+        initRadiotapCache(&radio->workers[i].radiotapCache);
+        initPoolCache(&radio->workers[i].packetCache);
+    }
+
+    if (plan != NULL) {
+        *plan++ = '\0';
+    }
+
+    radio->interface = arg;
+
+    if (plan == NULL) {
+        for (int i = 0; i < NUMCHANNELS; i++) {
+            radio->channels[i] = i + 1;
+        }
+        radio->numChannels = NUMCHANNELS;
+        return 0;
+    }
+
+    for (channel = strtok(plan, ","); channel != NULL; channel = strtok(NULL, ",")) {
+        value = strtol(channel, NULL, 10);
+        if (value < 1 || value > NUMCHANNELS || radio->numChannels == NUMCHANNELS) {
+            fprintf(stderr, "Invalid channel plan for %s\n", arg);
+            return 1;
+        }
+        radio->channels[radio->numChannels++] = value;
+    }
+
+    if (radio->numChannels == 0) {
+        fprintf(stderr, "Invalid channel plan for %s\n", arg);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Reads frames from the radio's libpcap handle until capture is stopped.
+ * The handle is non-blocking so the loop sees isPcapOpen cleared within a poll
+ * timeout even when no frames arrive, since pcap_breakloop can't wake another thread.
+ */
+void pcapLoop(struct captureWorker *worker) {
+    pcap_t *pcapHandle = worker->radio->pcapHandle;
+    struct pollfd pfd;
+
+    pfd.fd = pcap_get_selectable_fd(pcapHandle);
+    pfd.events = POLLIN;
+    while (isPcapOpen) {
+        int ret = pcap_dispatch(pcapHandle, -1, readPacket, (u_char *)worker);
+        if (ret == -1) {
+            fprintf(stderr, "Error capturing: %s\n", pcap_geterr(pcapHandle));
+            return;
+        }
+        if (ret == 0 && poll(&pfd, 1, RING_POLL_TIMEOUT) < 0 && errno != EINTR) {
+            fprintf(stderr, "Error waiting for frames: %s\n", strerror(errno));
+            return;
+        }
+    }
+}
+
+/* Thread for capturing frames on the given capture worker.
+ * Only returns when the capture handle is closed.
+ */
+void *captureLoop(void *arg) {
+    struct captureWorker *worker = arg;
+
+    if (usePcap) {
+        pcapLoop(worker);
+    } else {
+        ringLoop(&worker->captureRing, &isPcapOpen, readPacket, (u_char *)worker);
+    }
+
+    return NULL;
+}
 
-    printf("Finished initialisation.\n");
+/* Pushes every frame in the replay file through readPacket on the given
+ * radio, then logs how quickly they were processed and waits a short while
+ * for the queued readings to be published.
+ */
+void replayCapture(struct radio *radio) {
+    struct replayStats stats;
+    struct timespec sleepTime;
+
+    logMessage(LOG_LEVEL_INFO, LOG_CLASS_GENERAL, "Replaying %s %s.", replayFile,
+               replayFast ? "as fast as possible" : "at the recorded pace");
+
+    replayLoop(radio->pcapHandle, &isPcapOpen, !replayFast, readPacket,
+               (u_char *)&radio->workers[0], &stats);
+
+    logMessage(LOG_LEVEL_INFO, LOG_CLASS_GENERAL,
+               "Replayed %lu frames recorded over %.1f s in %.3f s, %.0f frames/s.",
+               stats.frames, stats.recordedSeconds, stats.seconds,
+               stats.seconds > 0.0 ? stats.frames / stats.seconds : 0.0);
+
+    for (int i = 0; i < REPLAY_DRAIN_TIME / 10 && getQueueSize(&packetQueue) > 0; i++) {
+        sleepTime.tv_sec = 0;
+        sleepTime.tv_nsec = 10000000L;
+        sleepFor(&sleepTime);
+    }
+
+    logMessage(LOG_LEVEL_INFO, LOG_CLASS_GENERAL,
+               "Published %lu messages, %lu failed, %lu readings dropped, %lu left queued.",
+               published, publishFailures, getQueueDropped(&packetQueue),
+               getQueueSize(&packetQueue));
+}
+
+/* Pushes synthetic frames through readPacket on the given radio as fast as
+ * possible and logs how quickly they were processed. The frames are
+ * timestamped at the generator's frame rate so devices age as they would live.
+ */
+void generateCapture(struct radio *radio) {
+    struct trafficConfig config;
+    struct trafficGenerator generator;
+    struct pcap_pkthdr header;
+    u_char buffer[GEN_FRAME_SIZE];
+    struct timeval now;
+    struct timespec start;
+    struct timespec end;
+    double seconds;
+    unsigned long i;
+
+    initTrafficConfig(&config);
+    gettimeofday(&now, NULL);
+    if (initGenerator(&generator, &config, &now)) {
+        return;
+    }
 
-    pcap_loop(pcapHandle, -1, readPacket, NULL);
+    logMessage(LOG_LEVEL_INFO, LOG_CLASS_GENERAL, "Processing %lu synthetic frames from %u devices.",
+               generateFrames, config.devices);
 
-    //Should never reach here but just incase...
-    cleanup(-1);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < generateFrames && isPcapOpen; i++) {
+        generateFrame(&generator, &header, buffer);
+        readPacket((u_char *)&radio->workers[0], &header, buffer);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    destroyGenerator(&generator);
+
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    logMessage(LOG_LEVEL_INFO, LOG_CLASS_GENERAL,
+               "Processed %lu frames in %.3f s, %.0f frames/s, %.0f ns per frame.",
+               i, seconds, seconds > 0.0 ? i / seconds : 0.0, i > 0 ? seconds * 1e9 / i : 0.0);
+    logMessage(LOG_LEVEL_INFO, LOG_CLASS_GENERAL,
+               "%lu frames filtered, %u devices tracked, %lu readings queued, %lu dropped.",
+               radio->workers[0].stats.filtered, getMacTableSize(&shards[0].devices),
+               getQueueSize(&packetQueue),
+               getQueueDropped(&packetQueue));
 }
 
 /*int runCommand(char *command, char **args) {
@@ -214,14 +795,44 @@ int runCommand(const char *command, char *arg) {
  */
 void cleanup(int ret) {
     void *status;
-    closePcap(pcapHandle);
-    signalList(&packetList);
-    if (isChannelThreadRunning) {
-        pthread_cancel(channelThread);
-        pthread_join(channelThread, &status);
-        isChannelThreadRunning = 0;
+
+    //Capture threads stop within a poll timeout, handles are only closed once they have
+    isPcapOpen = 0;
+    for (unsigned int i = 0; i < numRadios; i++) {
+        if (radios[i].isOpen && radios[i].pcapHandle != NULL) {
+            pcap_breakloop(radios[i].pcapHandle);
+        }
+    }
+    wakeQueue(&packetQueue);
+    if (isStatsThreadRunning) {
+        pthread_cancel(statsThread);
+        pthread_join(statsThread, &status);
+        isStatsThreadRunning = 0;
+    }
+    for (unsigned int i = 0; i < numRadios; i++) {
+        if (radios[i].isChannelThreadRunning) {
+            pthread_cancel(radios[i].channelThread);
+            pthread_join(radios[i].channelThread, &status);
+            radios[i].isChannelThreadRunning = 0;
+        }
+        for (unsigned int j = 0; j < radios[i].numWorkers; j++) {
+            if (radios[i].workers[j].isThreadRunning) {
+                pthread_join(radios[i].workers[j].thread, &status);
+                radios[i].workers[j].isThreadRunning = 0;
+            }
+        }
+        closeCapture(&radios[i]);
+        closeRecorder(&radios[i].recorder);
     }
     pthread_join(commsThread, &status);
+    if (useSpool) {     //Keep unsent readings for the next run
+        spoolQueue();
+        closeSpool(&spool);
+        useSpool = 0;
+    }
+    if (!isOffline) {   //Offline frames say nothing about the channels around the node
+        saveChannelState();
+    }
     if (isMQTTConnected) {
         isMQTTConnected = 0;
         mosquitto_disconnect(mosqConn);
@@ -232,42 +843,38 @@ void cleanup(int ret) {
         mosquitto_destroy(mosqConn);
         mosquitto_lib_cleanup();
     }
-    destroyList(&packetList, LIST_DELETE_DATA);
+    if (useNetlink) {
+        closeWifiControl(&wifiControl);
+    }
+    destroyQueue(&packetQueue);
     destroyStoredData();
-    kh_destroy(lastM, lastSentMap);
-    free(wifiInterface);
+    destroyPool(&packetPool);
+    destroyPool(&devicePool);
+    releaseRegisteredFilter(registeredFilter);
+    registeredFilter = NULL;
+    stopLog();
     exit(ret);
 }
 
 /* Clean up function for deleting and freeing all lists and map data.
  */
 void destroyStoredData(void) {
-    struct linkedList *list;
-    for (khint64_t it = kh_begin(packetMap); it != kh_end(packetMap); it++) {
-        if (kh_exist(packetMap, it)) {
-            list = kh_value(packetMap, it);
-            destroyList(list, LIST_DELETE_DATA);
-            free(list);
-        }
+    for (unsigned int i = 0; i < numWorkers; i++) {
+        destroyShard(&shards[i]);
     }
-    kh_destroy(pckM, packetMap);
 }
 
-/* Initialises the wifi interface and pcap handle.
- * Returns the newly created pcap handle for the given interface.
+/* Initialises the wifi interface and pcap handle of the given radio.
+ * Returns the newly created pcap handle for the radio's interface.
  */
-pcap_t* initialisePcap(char *device) {
+pcap_t* initialisePcap(struct radio *radio) {
+    char *device = radio->interface;
     pcap_t *pcapHandle;
     char errbuf[PCAP_ERRBUF_SIZE];
+    struct bpf_program program;
     int retval;
-    struct timespec sleepTime;
-
-    sleepTime.tv_sec = 0;
-    sleepTime.tv_nsec = 500000000L;
 
-    //Wait half a second then bring down wifi interface
-    nanosleep(&sleepTime, NULL);
-    runCommand(ifconfigDownCommand, wifiInterface);
+    bringInterface(device, 0);
 
     //Create pcap handle
     pcapHandle = pcap_create(device, errbuf);
@@ -286,9 +893,10 @@ pcap_t* initialisePcap(char *device) {
         return NULL;
     }
 
-    //Sleep for another half second before bringing interface up again
-    nanosleep(&sleepTime, NULL);
-    runCommand(ifconfigUpCommand, wifiInterface);
+    //Only capture the radiotap and 802.11 headers
+    pcap_set_snaplen(pcapHandle, captureSnaplen);
+
+    bringInterface(device, 1);
 
     //Make pcap handle active (will start receiving packets)
     retval = pcap_activate(pcapHandle);
@@ -299,6 +907,27 @@ pcap_t* initialisePcap(char *device) {
         return NULL;
     }
 
+    //Let the capture loop wait with a timeout so it notices when capture stops
+    if (pcap_setnonblock(pcapHandle, 1, errbuf)) {
+        fprintf(stderr, "Failed to make pcap handle non-blocking: %s\n", errbuf);
+        closePcap(pcapHandle);
+        return NULL;
+    }
+
+    //Drop beacons and other unwanted frames in the kernel
+    if (pcap_compile(pcapHandle, &program, captureFilter, 1, PCAP_NETMASK_UNKNOWN)) {
+        fprintf(stderr, "Failed to compile filter: %s\n", pcap_geterr(pcapHandle));
+        closePcap(pcapHandle);
+        return NULL;
+    }
+    retval = pcap_setfilter(pcapHandle, &program);
+    pcap_freecode(&program);
+    if (retval != 0) {
+        fprintf(stderr, "Failed to set filter: %s\n", pcap_geterr(pcapHandle));
+        closePcap(pcapHandle);
+        return NULL;
+    }
+
     //printf("link type: %d\n", pcap_datalink(pcapHandle));
     isPcapOpen = 1;
 
@@ -315,35 +944,130 @@ void closePcap(pcap_t *pcapHandle) {
     }
 }
 
-/* Callback function for pcap loop. Is called every time a packet is received.
+/* Puts the radio's interface in monitor mode and maps a TPACKET_V3 capture ring
+ * for each of its workers. Several workers share the frames through a fanout group.
+ * Returns 0 on success; otherwise non-zero.
+ */
+int initialiseRing(struct radio *radio) {
+    char *device = radio->interface;
+    int retval;
+    int group = -1;     //Fanout group of the radio's workers, made by the first to join
+
+    //Monitor mode can only be set while the interface is down
+    bringInterface(device, 0);
+    if (useNetlink) {
+        retval = setMonitorMode(&wifiControl, device);
+    } else {
+        retval = runCommand(iwconfigMonitorCommand, device);
+    }
+    if (retval != 0) {
+        fprintf(stderr, "Failed to enter monitor mode. Are you running as root?\n");
+        return 1;
+    }
+    bringInterface(device, 1);
+
+    for (unsigned int i = 0; i < radio->numWorkers; i++) {
+        struct captureRing *ring = &radio->workers[i].captureRing;
+
+        if (openRing(ring, device)) {
+            return 1;
+        }
+
+        //Drop beacons and other unwanted frames in the kernel
+        if (attachRingFilter(ring, captureFilter, captureSnaplen)) {
+            closeRing(ring);
+            return 1;
+        }
+
+        //Group ids are shared by the network namespace, so the first worker has the
+        //kernel pick one that is free and the others join it
+        if (radio->numWorkers > 1) {
+            group = joinRingFanout(ring, group);
+            if (group < 0) {
+                closeRing(ring);
+                return 1;
+            }
+        }
+    }
+
+    isPcapOpen = 1;
+
+    return 0;
+}
+
+/* Brings the given interface up or down.
+ * Wireless tools need half a second beforehand for the interface to settle.
+ * Returns 0 on success; otherwise non-zero.
+ */
+int bringInterface(char *device, char up) {
+    struct timespec sleepTime;
+
+    if (useNetlink) {
+        return setInterfaceUp(&wifiControl, device, up);
+    }
+
+    sleepTime.tv_sec = 0;
+    sleepTime.tv_nsec = 500000000L;
+    nanosleep(&sleepTime, NULL);
+    return runCommand(up ? ifconfigUpCommand : ifconfigDownCommand, device);
+}
+
+/* Closes whichever capture handle the given radio is using, including every
+ * worker's ring. The radio's capture threads must already have been joined.
+ */
+void closeCapture(struct radio *radio) {
+    if (!radio->isOpen) {
+        return;
+    }
+    radio->isOpen = 0;
+    if (usePcap) {
+        closePcap(radio->pcapHandle);
+    } else {
+        isPcapOpen = 0;
+        for (unsigned int i = 0; i < radio->numWorkers; i++) {
+            closeRing(&radio->workers[i].captureRing);
+        }
+    }
+}
+
+/* Callback function for pcap loop and capture ring. Is called every time a packet is received.
+ * args is the capture worker the packet was received on.
  */
 void readPacket(u_char *args, const struct pcap_pkthdr *header,
                 const u_char *packet) {
 
+    struct captureWorker *worker = (struct captureWorker *)args;
+    struct radio *radio = worker->radio;
+    struct deviceShard *shard = worker->shard;
     struct wisnPacket *wisnData;
     struct ieee80211_header *ieee80211Header;
     unsigned short channel;
-    struct ieee80211_radiotap_iterator iterator;
     struct ieee80211_radiotap_header *radiotapHeader = (struct ieee80211_radiotap_header*)(packet);
 
-    int retval = ieee80211_radiotap_iterator_init(&iterator, radiotapHeader,
-            header->caplen, NULL);
+    if (radio->recorder.dumper != NULL) {
+        recordFrame(&radio->recorder, header, packet);
+    }
+
+    //Ignore frames too short to hold a transmitter address
+    if (header->caplen < sizeof(*radiotapHeader) || header->caplen <
+            radiotapHeader->it_len + offsetof(struct ieee80211_header, address3)) {
+        worker->stats.filtered++;
+        return;
+    }
 
     ieee80211Header = (struct ieee80211_header *)(packet + radiotapHeader->it_len);
 
-    //Removes AP beacon spam
-    if (get802Type(ieee80211Header) != IEEE80211_MANAGEMENT || get802Subtype(ieee80211Header) != 8) {
-        int ret;
+    //Removes AP beacon spam that a custom filter let through and frames without a transmitter
+    if (get802Class(ieee80211Header) == IEEE80211_CLASS_TRANSMITTER) {
         unsigned char *addr;
-        char buff[16];
-        struct tm *tmInfo;
-        time_t now = time(NULL);
-        struct linkedList *list;
-        struct linkedNode *node;
-        struct linkedNode *nextNode;
-        struct wisnPacket *nodePacket;
-        khint64_t it;
+        unsigned char rssi;
+        char heardChannel;
+        double average;
+        double deviation;
+        time_t now = isOffline ? header->ts.tv_sec : time(NULL);
+        struct deviceState *device;
         unsigned long long mac = 0;
+
         /*if (get802Type(ieee80211Header) == IEEE80211_CONTROL && (get802Subtype(ieee80211Header) == 12 ||
           get802Subtype(ieee80211Header) == 13)) {
           addr = ieee80211Header->address1;
@@ -351,111 +1075,237 @@ void readPacket(u_char *args, const struct pcap_pkthdr *header,
         addr = ieee80211Header->address2;
         //}
 
+        //Most devices on air are not registered, so drop them before any other work
+        if (useRegistered && !isRegistered(addr)) {
+            worker->stats.unregistered++;
+            return;
+        }
+
         memcpy(&mac, addr, ARRAY_SIZE(ieee80211Header->address2));
-        wisnData = malloc(sizeof(*wisnData));
-        wisnData->timestamp = (unsigned long long)now;
-        memcpy(wisnData->mac, addr, ARRAY_SIZE(wisnData->mac));
-        wisnData->nodeNum = nodeNum;
-        wisnData->rssi = 0;
-        channel = 0;
-
-        //Check for
-        //if (radiotapHeader->it_present & 0x810) {
-        while (!retval) {
-            retval = ieee80211_radiotap_iterator_next(&iterator);
-            if (retval) {
-                continue;
-            }
 
-            if (iterator.this_arg_index == IEEE80211_RADIOTAP_CHANNEL) {
-                channel = *((unsigned short *)iterator.this_arg);
-            } else if (iterator.this_arg_index == IEEE80211_RADIOTAP_DBM_ANTSIGNAL) {
-                wisnData->rssi = 256 - *(iterator.this_arg);
-                break;
-            } else if (iterator.this_arg_index == IEEE80211_RADIOTAP_DB_ANTSIGNAL) {
-                wisnData->rssi = *(iterator.this_arg);
-                break;
-            }
+        //Offsets are cached per radiotap layout, the generic iterator handles new ones
+        readRadiotapFields(&worker->radiotapCache, packet, header->caplen, &channel, &rssi);
+
+        //Use the channel the frame was heard on if the radiotap header gives a 2.4 GHz one
+        heardChannel = channel >= 2412 && channel <= 2484 ? getChannel(channel) : 0;
+        if (heardChannel >= 1 && heardChannel <= NUMCHANNELS) {
+            worker->stats.channelFrames[heardChannel - 1]++;
+        } else {
+            worker->stats.channelFrames[radio->channels[radio->channelIndex] - 1]++;
         }
-        //}
 
-        //Increment channel packet counter if running
-        if (isChannelReady) {
-            packetTotals[channelIndex]++;
-        }
-
-        it = kh_get(pckM, packetMap, mac);
-        if (it != kh_end(packetMap)) { //An entry for this device already exists
-            list = kh_value(packetMap, it);
-            node = list->head;
-            while (node != NULL) {
-                nodePacket = node->data;
-                //Remove readings older than x minutes and prune to AVGNUM size
-                if (list->size >= AVGNUM || now - nodePacket->timestamp > AVGTIMEOUT) {
-                    nextNode = node->next;
-                    removeNode(list, node, LIST_NO_LOCK, LIST_DELETE_DATA);
-                    node = nextNode;
-                } else {
-                    break;  //Chronological order so no nodes past current will be older
-                }
+        //Only shared with the same worker of the other radios
+        lockShard(shard);
+
+        //Forget devices that have gone quiet
+        advanceWheel(&shard->deviceWheel, now, expireDevice, shard);
+
+        device = getFromMacTable(&shard->devices, mac);
+        if (device == NULL) { //No entry exists
+            if (getMacTableSize(&shard->devices) >= shard->maxDevices) {
+                evictDevice(shard);
             }
-        } else { //No entry exists
-            list = malloc(sizeof(struct linkedList));
-            initList(list);
-            it = kh_put(pckM, packetMap, mac, &ret);
-            kh_value(packetMap, it) = list;
-        }
-        addDataToTailList(list, clonePacket(wisnData));
-
-        //Calculate average reading from list
-        wisnData->rssi = 0;
-        node = list->head;
-        while (node != NULL) {
-            nodePacket = node->data;
-            wisnData->rssi += (double)nodePacket->rssi;
-            node = node->next;
-        }
-        wisnData->rssi /= (double)list->size;
-
-        memset(buff, 0, ARRAY_SIZE(buff));
-        tmInfo = localtime(&now);
-        strftime(buff, ARRAY_SIZE(buff), "%X", tmInfo);
-        printf("time: %s, type: %u, subtype: %u, channel: %u %02X:%02X:%02X:%02X:%02X:%02X - %02X:%02X:%02X:%02X:%02X:%02X - %f dBm\n",
-                buff, get802Type(ieee80211Header), get802Subtype(ieee80211Header), getChannel(channel),
-                ieee80211Header->address1[0], ieee80211Header->address1[1], ieee80211Header->address1[2],
-                ieee80211Header->address1[3], ieee80211Header->address1[4], ieee80211Header->address1[5],
-                wisnData->mac[0], wisnData->mac[1], wisnData->mac[2], wisnData->mac[3], wisnData->mac[4],
-                wisnData->mac[5], wisnData->rssi);
-
-        it = kh_get(lastM, lastSentMap, mac);
-        if (it != kh_end(lastSentMap)) { //An entry for this device already exists
-            if (now - kh_value(lastSentMap, it) > 0) {
-                kh_value(lastSentMap, it) = now;
-                addDataToTailList(&packetList, wisnData);
+            device = poolGet(&devicePool, NULL);
+            if (device == NULL) {   //Only when built without a heap fallback
+                unlockShard(shard);
+                return;
             }
-        } else { //No existing entry
-            it = kh_put(lastM, lastSentMap, mac, &ret);
-            kh_value(lastSentMap, it) = now;
-            addDataToTailList(&packetList, wisnData);
+            initAverage(&device->readings);
+            device->mac = mac;
+            memset(device->seenSlot, 0, sizeof(device->seenSlot));
+            device->isReported = 0;
+            addToWheel(&shard->deviceWheel, &device->expiry, now + idleTimeout);
+            putInMacTable(&shard->devices, mac, device);
         }
-    }
-}
+        device->lastSeen = now;
 
-/* Changes the wifi channel of the wifi interface using iwconfig.
- */
-void changeChannel(char channel) {
-    char command[32];
-    int retval;
-    printf("Changing channel to %d\n", channel);
-    if (channel < 15 && channel > 0) {
-        memset(command, 0, ARRAY_SIZE(command));
-        snprintf(command, ARRAY_SIZE(command), iwconfigChannelCommand,
-                 wifiInterface, channel);
-        retval = runCommand((const char *)command, NULL);
-        if (retval != 0) {
-            fprintf(stderr, "Error changing channel %d\n", retval);
+        //Count each device once per channel slot for the scheduler, separately for each
+        //radio so a device heard on several doesn't reset the others' counts
+        if (device->seenSlot[radio - radios] != radio->slot) {
+            device->seenSlot[radio - radios] = radio->slot;
+            __atomic_add_fetch(&radio->slotDevices, 1, __ATOMIC_RELAXED);
         }
-    }
+
+        //Expires old readings and updates the running sums and sorted readings
+        addReading(&device->readings, now, rssi);
+
+        if (isLogLevelEnabled(LOG_LEVEL_DEBUG)) {
+            logMessage(LOG_LEVEL_DEBUG, LOG_CLASS_FRAME,
+                    "type: %u, subtype: %u, channel: %u %02X:%02X:%02X:%02X:%02X:%02X - %02X:%02X:%02X:%02X:%02X:%02X - %f dBm",
+                    get802Type(ieee80211Header), get802Subtype(ieee80211Header), getChannel(channel),
+                    ieee80211Header->address1[0], ieee80211Header->address1[1], ieee80211Header->address1[2],
+                    ieee80211Header->address1[3], ieee80211Header->address1[4], ieee80211Header->address1[5],
+                    addr[0], addr[1], addr[2], addr[3], addr[4], addr[5],
+                    getEstimate(&device->readings, estimator));
+        }
+
+        if (device->isReported && now - device->lastSent <= 0) {
+            unlockShard(shard);
+            return;     //Already sent a reading for this device this second
+        }
+
+        //Only readings that may be sent need the estimate worked out
+        average = getEstimate(&device->readings, estimator);
+
+        //The server keeps the last reading until it times out, so only changes are needed
+        if (device->isReported && reportDeadband > 0.0 &&
+            fabs(average - device->sentAverage) <= reportDeadband &&
+            now - device->lastSent < maxSilence) {
+            shard->unchangedReadings++;
+            unlockShard(shard);
+            return;
+        }
+        device->isReported = 1;
+        device->lastSent = now;
+        device->sentAverage = average;
+        deviation = getDeviation(&device->readings);
+
+        unlockShard(shard);
+
+        wisnData = poolGet(&packetPool, &worker->packetCache);
+        if (wisnData == NULL) { //Only when built without a heap fallback
+            return;
+        }
+        wisnData->timestamp = (unsigned long long)now;
+        memcpy(wisnData->mac, addr, ARRAY_SIZE(wisnData->mac));
+        wisnData->nodeNum = nodeNum;
+        wisnData->rssi = average;
+        wisnData->rssiDeviation = deviation;
+        enqueue(&packetQueue, wisnData);    //Drops the oldest reading if the queue is full
+    } else {
+        worker->stats.filtered++;
+    }
+}
+
+/* Initialises the given shard to hold up to maxDevices with its wheel at now.
+ * Returns 0 on success; otherwise -1
+ */
+int initShard(struct deviceShard *shard, unsigned int maxDevices, char isShared, time_t now) {
+    if (initMacTable(&shard->devices, maxDevices)) {
+        return -1;
+    }
+    initWheel(&shard->deviceWheel, now);
+    shard->isShared = isShared;
+    shard->maxDevices = maxDevices;
+    shard->idleEvictions = 0;
+    shard->capEvictions = 0;
+    shard->unchangedReadings = 0;
+    if (isShared && pthread_mutex_init(&shard->mutex, NULL)) {
+        fprintf(stderr, "Error creating shard mutex.\n");
+    }
+    return 0;
+}
+
+/* Frees every device in the given shard and its maps.
+ */
+void destroyShard(struct deviceShard *shard) {
+    if (shard->devices.keys == NULL) {
+        return;
+    }
+    for (unsigned int i = 0; i <= shard->devices.mask; i++) {
+        poolPut(&devicePool, NULL, getMacTableValue(&shard->devices, i));
+    }
+    destroyMacTable(&shard->devices);
+    if (shard->isShared) {
+        pthread_mutex_destroy(&shard->mutex);
+    }
+}
+
+/* Acquires the shard's mutex if other radios' workers also use it.
+ */
+void lockShard(struct deviceShard *shard) {
+    while (shard->isShared && pthread_mutex_lock(&shard->mutex)) {
+        fprintf(stderr, "Error acquiring shard mutex.\n");
+    }
+}
+
+/* Releases the shard's mutex if other radios' workers also use it.
+ */
+void unlockShard(struct deviceShard *shard) {
+    if (shard->isShared && pthread_mutex_unlock(&shard->mutex)) {
+        fprintf(stderr, "Error releasing shard mutex.\n");
+    }
+}
+
+/* Called by a shard's device wheel when a device's expiry comes round. Devices
+ * heard since it was set are put back on the wheel; otherwise forgotten.
+ * arg is the shard. Must be called with the shard locked.
+ */
+void expireDevice(struct wheelEntry *entry, void *arg) {
+    struct deviceShard *shard = arg;
+    struct deviceState *device = wheelEntryOf(entry, struct deviceState, expiry);
+
+    if (device->lastSeen + idleTimeout > shard->deviceWheel.now) {
+        addToWheel(&shard->deviceWheel, entry, device->lastSeen + idleTimeout);
+        return;
+    }
+
+    shard->idleEvictions++;
+    removeDevice(shard, device);
+}
+
+/* Forgets the device due to expire soonest in the shard to make room for a new one.
+ * Must be called with the shard locked.
+ */
+void evictDevice(struct deviceShard *shard) {
+    struct wheelEntry *entry;
+    struct deviceState *device;
+
+    while ((entry = getNextExpiry(&shard->deviceWheel)) != NULL) {
+        device = wheelEntryOf(entry, struct deviceState, expiry);
+
+        //Expiries are only moved when they come round, so fix any that are stale
+        if (device->lastSeen + idleTimeout > entry->expires) {
+            removeFromWheel(&shard->deviceWheel, entry);
+            addToWheel(&shard->deviceWheel, entry, device->lastSeen + idleTimeout);
+            continue;
+        }
+
+        removeFromWheel(&shard->deviceWheel, entry);
+        shard->capEvictions++;
+        removeDevice(shard, device);
+        return;
+    }
+}
+
+/* Removes the device from the shard's table and frees it. The device must
+ * already be off the device wheel.
+ * Must be called with the shard locked.
+ */
+void removeDevice(struct deviceShard *shard, struct deviceState *device) {
+    removeFromMacTable(&shard->devices, device->mac);
+    poolPut(&devicePool, NULL, device);
+}
+
+/* Changes the wifi channel of the radio's interface using nl80211 or iwconfig.
+ */
+void changeChannel(struct radio *radio, char channel) {
+    char command[32];
+    int retval;
+    struct timespec start;
+    struct timespec end;
+
+    logMessage(LOG_LEVEL_DEBUG, LOG_CLASS_CHANNEL, "Changing channel on %s to %d",
+               radio->interface, channel);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (channel < 15 && channel > 0 && useNetlink) {
+        if (setWifiChannel(&wifiControl, radio->interface, channel)) {
+            logMessage(LOG_LEVEL_ERROR, LOG_CLASS_CHANNEL, "Error changing channel");
+        }
+    } else if (channel < 15 && channel > 0) {
+        memset(command, 0, ARRAY_SIZE(command));
+        snprintf(command, ARRAY_SIZE(command), iwconfigChannelCommand,
+                 radio->interface, channel);
+        retval = runCommand((const char *)command, NULL);
+        if (retval != 0) {
+            logMessage(LOG_LEVEL_ERROR, LOG_CLASS_CHANNEL, "Error changing channel %d", retval);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    radio->stats.switches++;
+    radio->stats.switchMicros += (end.tv_sec - start.tv_sec) * 1000000ULL +
+                                 (end.tv_nsec - start.tv_nsec) / 1000;
 }
 
 /* Converts the given frequency to the correct wifi channel.
@@ -473,85 +1323,171 @@ char getChannel(short frequency) {
     return -1;
 }
 
-/* Thread responsible for switching wifi channels periodically.
+/* Thread responsible for switching the given radio between the channels in its
+ * plan. Each slot of dwellTime milliseconds goes to the channel the scheduler
+ * picks from how many distinct devices recent slots on each channel found.
  * Only returns when the pcap handle is closed.
  */
 void *channelSwitcher(void *arg) {
+    struct radio *radio = arg;
     struct timespec sleepTime;
-    struct timespec sleepTimeLeft;
-    time_t channelTimes[NUMCHANNELS];
-    volatile unsigned char currentChannel = 0;
-    volatile unsigned char detectPhase = 1;
+    unsigned int index;
 
-    if (singleChannel) {
-        changeChannel(singleChannel);
+    if (radio->numChannels == 1) {  //Parked on a single channel
+        changeChannel(radio, radio->channels[0]);
         pthread_exit(NULL);
     }
 
     while (isPcapOpen) {
-        if (detectPhase) {
-            isChannelReady = 1;
-            currentChannel++;
-            channelIndex = currentChannel - 1;
-            changeChannel(currentChannel);
-            sleepTime.tv_sec = 21;
-            sleepTime.tv_nsec = 500000000L;
-            if (currentChannel == 14) {
-                detectPhase = 0;
-                currentChannel = 255;
-            }
-        } else {
-            if (currentChannel == 255) {
-                calculateChannelTimeSlices(channelTimes);
-                currentChannel = 0;
-            }
-            currentChannel++;
-            if (currentChannel > 14) {
-                detectPhase = 1;
-                currentChannel = 0;
-                continue;
-            }
-            channelIndex = currentChannel - 1;
-            if (channelTimes[channelIndex] > 0) {
-                sleepTime.tv_sec = channelTimes[channelIndex];
-                sleepTime.tv_nsec = 0;
-                changeChannel(currentChannel);
-            } else {
-                continue;
-            }
-            if (currentChannel == 14) {
-                detectPhase = 1;
-                currentChannel = 0;
-            }
+        index = nextChannel(&radio->scheduler);
+        if (index != radio->channelIndex || radio->slot == 0) {
+            radio->channelIndex = index;
+            changeChannel(radio, radio->channels[index]);
         }
 
-        while (nanosleep(&sleepTime, &sleepTimeLeft) != 0) {
-            memcpy(&sleepTime, &sleepTimeLeft, sizeof(sleepTimeLeft));
+        //Start a new slot so devices are counted again
+        radio->slotDevices = 0;
+        radio->slot = __atomic_add_fetch(&nextSlot, 1, __ATOMIC_RELAXED);
+
+        sleepTime.tv_sec = dwellTime / 1000;
+        sleepTime.tv_nsec = (dwellTime % 1000) * 1000000L;
+        sleepFor(&sleepTime);
+
+        updateChannelRate(&radio->scheduler, index, radio->slotDevices, dwellTime / 1000.0);
+
+        if (radio->scheduler.slots[index] % SCHED_REPORT_SLOTS == 0) {
+            logChannelRates(radio);
+        }
+
+        //Whichever radio's switcher gets there first saves the rates for all of them
+        if (time(NULL) >= nextStateSave && pthread_mutex_trylock(&stateMutex) == 0) {
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+            nextStateSave = time(NULL) + STATE_SAVE_INTERVAL;
+            saveChannelState();
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+            pthread_mutex_unlock(&stateMutex);
         }
     }
     pthread_exit(NULL);
 }
 
-/* Calculates how much time to spend listening on each channel
+/* Sleeps for the given time, resuming if interrupted by a signal.
+ * Nanoseconds of a second or more are carried into the seconds, since
+ * nanosleep rejects them and retrying would spin.
+ */
+void sleepFor(struct timespec *sleepTime) {
+    struct timespec sleepTimeLeft;
+
+    sleepTime->tv_sec += sleepTime->tv_nsec / 1000000000L;
+    sleepTime->tv_nsec %= 1000000000L;
+
+    while (nanosleep(sleepTime, &sleepTimeLeft) != 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "Error sleeping: %s\n", strerror(errno));
+            return;
+        }
+        memcpy(sleepTime, &sleepTimeLeft, sizeof(sleepTimeLeft));
+    }
+}
+
+/* Logs each channel's discovery rate and share of slots for the given radio.
  */
-void calculateChannelTimeSlices(time_t *channelTime) {
-    unsigned int totalPackets = 0;
+void logChannelRates(struct radio *radio) {
+    struct channelScheduler *scheduler = &radio->scheduler;
 
-    isChannelReady = 0;
+    for (unsigned int i = 0; i < scheduler->numChannels; i++) {
+        logMessage(LOG_LEVEL_INFO, LOG_CLASS_CHANNEL,
+                   "%s channel %d finds %.2f devices/s, %lu slots",
+                   radio->interface, radio->channels[i], scheduler->rate[i], scheduler->slots[i]);
+    }
+}
 
-    for (int i = 0; i < ARRAY_SIZE(packetTotals); i++) {
-        totalPackets += packetTotals[i];
+/* Reads the channel rates saved by a previous run into the schedulers of the
+ * radios, matching them by interface and channel. Channels missing from the
+ * file start with no history.
+ * Returns 0 on success; otherwise non-zero.
+ */
+int loadChannelState(void) {
+    FILE *file;
+    char line[64];
+    char interface[IFNAMSIZ];
+    int channel;
+    double rate;
+    unsigned int loaded = 0;
+
+    file = fopen(stateFile, "r");
+    if (file == NULL) {
+        logMessage(LOG_LEVEL_INFO, LOG_CLASS_CHANNEL, "No channel state in %s, starting cold.",
+                   stateFile);
+        return 1;
     }
 
-    printf("Total packets: %d\n", totalPackets);
-    for (int i = 0; i < NUMCHANNELS; i++) {
-        channelTime[i] = 3600 * packetTotals[i] / totalPackets;
-        printf("Channel %d received %d packets, allocating %d seconds.\n",
-               i + 1, packetTotals[i], (int)channelTime[i]);
-        packetTotals[i] = 0;
+    //Ignore files from other versions rather than misreading them
+    if (fgets(line, ARRAY_SIZE(line), file) == NULL || strcmp(line, STATE_HEADER "\n") != 0) {
+        logMessage(LOG_LEVEL_WARN, LOG_CLASS_CHANNEL, "Ignoring unrecognised channel state in %s.",
+                   stateFile);
+        fclose(file);
+        return 1;
     }
+    while (fscanf(file, "%15s %d %lf", interface, &channel, &rate) == 3) {
+        if (!isfinite(rate) || rate < 0.0) {
+            continue;
+        }
+        for (unsigned int i = 0; i < numRadios; i++) {
+            if (strcmp(radios[i].interface, interface) != 0) {
+                continue;
+            }
+            for (unsigned int j = 0; j < radios[i].numChannels; j++) {
+                if (radios[i].channels[j] == channel) {
+                    radios[i].scheduler.rate[j] = rate;
+                    loaded++;
+                }
+            }
+        }
+    }
+    fclose(file);
 
-    //isChannelReady = 1;
+    logMessage(LOG_LEVEL_INFO, LOG_CLASS_CHANNEL, "Loaded %u channel rates from %s.",
+               loaded, stateFile);
+    return 0;
+}
+
+/* Writes the channel rates of every radio to the state file. The file is
+ * written beside the old one and renamed over it so a power cut never leaves
+ * a partial file.
+ * Returns 0 on success; otherwise non-zero.
+ */
+int saveChannelState(void) {
+    FILE *file;
+    char tempFile[PATH_MAX];
+    int ret = 0;
+
+    snprintf(tempFile, ARRAY_SIZE(tempFile), "%s.tmp", stateFile);
+    file = fopen(tempFile, "w");
+    if (file == NULL) {
+        logMessage(LOG_LEVEL_WARN, LOG_CLASS_CHANNEL, "Unable to write channel state to %s.",
+                   tempFile);
+        return 1;
+    }
+
+    fprintf(file, STATE_HEADER "\n");
+    for (unsigned int i = 0; i < numRadios; i++) {
+        for (unsigned int j = 0; j < radios[i].numChannels; j++) {
+            fprintf(file, "%s %d %f\n", radios[i].interface, radios[i].channels[j],
+                    radios[i].scheduler.rate[j]);
+        }
+    }
+
+    if (fflush(file) != 0 || fsync(fileno(file)) != 0) {
+        ret = 1;
+    }
+    if (fclose(file) != 0 || ret || rename(tempFile, stateFile) != 0) {
+        logMessage(LOG_LEVEL_WARN, LOG_CLASS_CHANNEL, "Unable to save channel state to %s.",
+                   stateFile);
+        unlink(tempFile);
+        return 1;
+    }
+    return 0;
 }
 
 /* Compares the two given MAC addresses
@@ -592,44 +1528,6 @@ char checkInterface(char *interface) {
     return match;
 }
 
-/* Converts the data from a wisnPacket struct in a serialised form.
- * Returns a pointer to a buffer containing the serialised data.
- */
-/*unsigned char *serialiseWisnPacket(struct wisnPacket *packet, unsigned int *size) {
-  unsigned char *buffer;
-  unsigned char *marker;
-
- *size = sizeof(packet->timestamp) + ARRAY_SIZE(packet->mac) +
- sizeof(packet->rssi) + sizeof(packet->nodeNum);
-
- buffer = malloc(*size);
- marker = buffer;
-
- packet->timestamp = htobe64(packet->timestamp);
- memcpy(marker, &(packet->timestamp), sizeof(packet->timestamp));
- marker += sizeof(packet->timestamp);
-
- memcpy(marker, packet->mac, ARRAY_SIZE(packet->mac));
- marker += ARRAY_SIZE(packet->mac);
-
- memcpy(marker, &(packet->rssi), sizeof(packet->rssi));
- marker += sizeof(packet->rssi);
-
- packet->nodeNum = htons(packet->nodeNum);
- memcpy(marker, &(packet->nodeNum), sizeof(packet->nodeNum));
- marker += sizeof(packet->nodeNum);
-
- return buffer;
- }*/
-
-/* Signals anything waiting on the given list.
- */
-void signalList(struct linkedList *list) {
-    if (pthread_cond_signal((&list->cond))) {
-        fprintf(stderr, "Error signalling condition variable.\n");
-    }
-}
-
 /* Attempts to connect to the given MQTT broker.
  */
 unsigned int connectToBroker(char *address, unsigned int nodeNum, int port) {
@@ -653,9 +1551,10 @@ unsigned int connectToBroker(char *address, unsigned int nodeNum, int port) {
         return res;
     }
     isMQTTConnected = 1;
-    packetList.doSignal = 1;
 
     mosquitto_reconnect_delay_set(mosqConn, RECONNECTDELAY, RECONNECTDELAY, 0);
+    mosquitto_connect_callback_set(mosqConn, connectedToBroker);
+    mosquitto_message_callback_set(mosqConn, receivedMessage);
 
     res = mosquitto_loop_start(mosqConn);
     if (res != MOSQ_ERR_SUCCESS) {
@@ -666,56 +1565,482 @@ unsigned int connectToBroker(char *address, unsigned int nodeNum, int port) {
     return res;
 }
 
+/* Puts a packet back in the packet pool from any thread. Used by the packet
+ * queue for readings it drops.
+ */
+void freePacket(void *packet) {
+    poolPut(&packetPool, NULL, packet);
+}
+
+/* Callback function for when a connection to the MQTT broker is made.
+ * Subscriptions don't survive a reconnect so they are made every time.
+ */
+void connectedToBroker(struct mosquitto *conn, void *args, int result) {
+    if (result == 0 && useRegistered) {
+        mosquitto_subscribe(conn, NULL, REGISTERED_TOPIC, 1);
+    }
+}
+
+/* Callback function for when a message is received from the MQTT broker.
+ */
+void receivedMessage(struct mosquitto *conn, void *args,
+                     const struct mosquitto_message *message) {
+
+    if (strcmp(REGISTERED_TOPIC, message->topic) == 0) {
+        updateRegisteredFilter(message->payload, message->payloadlen);
+    }
+}
+
+/* Replaces the registered filter with the one in the given message. An empty
+ * message means the server no longer publishes one, so every device is tracked.
+ * Devices already tracked that aren't registered are forgotten when they go idle.
+ */
+void updateRegisteredFilter(const unsigned char *payload, int length) {
+    struct macFilter *filter = NULL;
+    struct macFilter *oldFilter;
+
+    if (length > 0) {
+        filter = readRegisteredFilter(payload, length);
+        if (filter == NULL) {
+            logMessage(LOG_LEVEL_WARN, LOG_CLASS_GENERAL, "Invalid registered devices message");
+            return;
+        }
+        if (registeredFilter != NULL && registeredFilter->generation == filter->generation) {
+            releaseRegisteredFilter(filter);    //Already have this one
+            return;
+        }
+    }
+
+    pthread_rwlock_wrlock(&filterLock);
+    oldFilter = registeredFilter;
+    registeredFilter = filter;
+    pthread_rwlock_unlock(&filterLock);
+
+    releaseRegisteredFilter(oldFilter);
+
+    if (filter != NULL) {
+        logMessage(LOG_LEVEL_INFO, LOG_CLASS_GENERAL, "Tracking %u registered devices",
+                   filter->size);
+    } else {
+        logMessage(LOG_LEVEL_INFO, LOG_CLASS_GENERAL, "Tracking every device");
+    }
+}
+
+/* Reads the registered devices in the given message into a filter that isn't in use.
+ * The static build alternates between two fixed buffers, which is safe as only the
+ * MQTT callback changes the filter and readers are done with the old one once it is swapped.
+ * Returns the filter or NULL if the message isn't valid or has too many devices
+ */
+struct macFilter *readRegisteredFilter(const unsigned char *payload, int length) {
+    struct macFilter *filter;
+
+#ifdef WISN_STATIC
+    filter = registeredFilter == &filterBuffers[0] ? &filterBuffers[1] : &filterBuffers[0];
+    filter->keys = filter == &filterBuffers[0] ? filterKeys[0] : filterKeys[1];
+    if (readMacFilter(filter, REGISTERED_MAX, payload, length)) {
+        return NULL;
+    }
+#else
+    filter = malloc(sizeof(*filter));
+    if (filter == NULL) {
+        return NULL;
+    }
+    if (deserialiseMacFilter(filter, payload, length)) {
+        free(filter);
+        return NULL;
+    }
+#endif
+
+    return filter;
+}
+
+/* Frees a filter from readRegisteredFilter that is no longer in use.
+ */
+void releaseRegisteredFilter(struct macFilter *filter) {
+#ifndef WISN_STATIC
+    if (filter != NULL) {
+        destroyMacFilter(filter);
+        free(filter);
+    }
+#endif
+}
+
+/* Checks the given MAC against the devices registered with the server.
+ * Returns 1 if it is registered or no registered devices have been received; otherwise 0
+ */
+char isRegistered(const unsigned char *mac) {
+    char found = 1;
+
+    pthread_rwlock_rdlock(&filterLock);
+    if (registeredFilter != NULL) {
+        found = isInMacFilter(registeredFilter, macToKey(mac));
+    }
+    pthread_rwlock_unlock(&filterLock);
+
+    return found;
+}
+
 /* Thread for sending all received wifi packets to the server.
  */
 void *sendToServer(void *arg) {
-    char buffer[256];
-    int ret;
+    struct wisnPacket *packet = NULL;
+    int backoff = PUBLISH_BACKOFF_MIN;
+
+    while (isPcapOpen) {
+        if (isSpooling()) {     //Catch up on the spool before anything newer
+            if (drainSpool() == 0) {
+                backoff = PUBLISH_BACKOFF_MIN;
+            } else {
+                waitBackoff(&backoff);
+            }
+            continue;
+        }
 
-    while (pthread_mutex_lock(&(packetList.mutex))) {
-        fprintf(stderr, "Error acquiring list mutex.\n");
+        if (packet == NULL) {   //Previous packet was sent so wait for another
+            waitQueue(&packetQueue, 1, -1);
+            packet = dequeue(&packetQueue);
+            if (packet == NULL) {
+                continue;
+            }
+        }
+
+        if (publishPackets(&packet, 1) == 0) {
+            poolPut(&packetPool, &commsCache, packet);
+            packet = NULL;
+            backoff = PUBLISH_BACKOFF_MIN;
+        } else if (useSpool) {
+            spoolPackets(&packet, 1);
+            packet = NULL;
+        } else {    //Keep the packet and retry it after a wait
+            waitBackoff(&backoff);
+        }
     }
 
+    poolPut(&packetPool, &commsCache, packet);
+
+    pthread_exit(NULL);
+}
+
+/* Thread for sending received wifi packets to the server in batches.
+ * Waits up to batchTime milliseconds after the first queued packet for more to
+ * arrive, then publishes up to BATCH_MAX_PACKETS of them in a single message.
+ */
+void *sendBatchesToServer(void *arg) {
+    struct wisnPacket *batch[BATCH_MAX_PACKETS];
+    unsigned int batchSize = 0;
+    int backoff = PUBLISH_BACKOFF_MIN;
+
     while (isPcapOpen) {
-        while (packetList.head == NULL && isPcapOpen) {
-            if (pthread_cond_wait(&(packetList.cond), &(packetList.mutex))) {
-                fprintf(stderr, "Error waiting for condition variable signal\n");
+        if (isSpooling()) {     //Catch up on the spool before anything newer
+            if (drainSpool() == 0) {
+                backoff = PUBLISH_BACKOFF_MIN;
+            } else {
+                waitBackoff(&backoff);
             }
+            continue;
         }
 
-        if (!isPcapOpen) {
-            break;
+        if (batchSize == 0) {   //Previous batch was sent so collect a new one
+            if (waitQueue(&packetQueue, 1, -1) == 0) {
+                continue;
+            }
+
+            //Give the capture threads until the deadline to fill the batch
+            waitQueue(&packetQueue, BATCH_MAX_PACKETS, batchTime);
+            batchSize = dequeueBatch(&packetQueue, (void **)batch, BATCH_MAX_PACKETS);
+            if (batchSize == 0) {
+                continue;
+            }
         }
 
-        JSONisePacket(packetList.head->data, buffer, ARRAY_SIZE(buffer));
-        ret = mosquitto_publish(mosqConn, NULL, MQTTTopic, strlen(buffer), buffer, 0, 0);
-        if (ret == MOSQ_ERR_INVAL) {
-            fprintf(stderr, "Error sending message - Invalid parameters.\n");
-        } else if (ret == MOSQ_ERR_NO_CONN) {
-            fprintf(stderr, "Error sending message - No connection.\n");
-        } else if (ret == MOSQ_ERR_PROTOCOL) {
-            fprintf(stderr, "Error sending message - Protocol error.\n");
-        } else if (ret == MOSQ_ERR_PAYLOAD_SIZE) {
-            fprintf(stderr, "Error sending message - Payload too large.\n");
-        } else {
-            removeFromHeadList(&packetList, LIST_HAVE_LOCK, LIST_DELETE_DATA);
+        if (publishPackets(batch, batchSize) == 0) {
+            for (unsigned int i = 0; i < batchSize; i++) {
+                poolPut(&packetPool, &commsCache, batch[i]);
+            }
+            batchSize = 0;
+            backoff = PUBLISH_BACKOFF_MIN;
+        } else if (useSpool) {
+            spoolPackets(batch, batchSize);
+            batchSize = 0;
+        } else {    //Keep the batch and retry it after a wait
+            waitBackoff(&backoff);
         }
     }
 
-    if (pthread_mutex_unlock(&(packetList.mutex))) {
-        fprintf(stderr, "Error releasing list mutex.\n");
+    for (unsigned int i = 0; i < batchSize; i++) {
+        poolPut(&packetPool, &commsCache, batch[i]);
     }
 
     pthread_exit(NULL);
 }
 
+/* Encodes and publishes the given packets in one message.
+ * Returns 0 if the publish succeeded; otherwise non-zero.
+ */
+int publishPackets(struct wisnPacket **packets, unsigned int num) {
+    char buffer[BATCH_BUFFER_SIZE];
+    int length;
+    int ret;
+
+    length = encodePackets(packets, num, buffer, ARRAY_SIZE(buffer));
+    ret = mosquitto_publish(mosqConn, NULL, MQTTTopic, length, buffer, 0, 0);
+    if (checkPublish(ret)) {
+        return 1;
+    }
+    published++;
+    return 0;
+}
+
+/* Checks if there are readings in the spool, which must be sent before any
+ * newer ones.
+ * Returns non-zero if there are; otherwise 0.
+ */
+char isSpooling(void) {
+    return useSpool && getSpoolSize(&spool) > 0;
+}
+
+/* Moves the packets the broker could not take into the spool and frees them.
+ */
+void spoolPackets(struct wisnPacket **packets, unsigned int num) {
+    if (getSpoolSize(&spool) == 0) {
+        logMessage(LOG_LEVEL_WARN, LOG_CLASS_PUBLISH,
+                   "Broker unreachable, keeping readings in %s.", spoolFile);
+    }
+
+    spoolWrite(&spool, packets, num);
+    for (unsigned int i = 0; i < num; i++) {
+        poolPut(&packetPool, &commsCache, packets[i]);
+    }
+}
+
+/* Moves every queued packet into the spool behind the ones already there.
+ */
+void spoolQueue(void) {
+    struct wisnPacket *batch[BATCH_MAX_PACKETS];
+    unsigned int num;
+
+    while ((num = dequeueBatch(&packetQueue, (void **)batch, ARRAY_SIZE(batch))) > 0) {
+        spoolPackets(batch, num);
+    }
+}
+
+/* Publishes the oldest batch of spooled readings, after moving any queued
+ * readings behind them so order is kept.
+ * Returns 0 if a batch was sent; otherwise non-zero.
+ */
+int drainSpool(void) {
+    struct wisnPacket records[BATCH_MAX_PACKETS];
+    struct wisnPacket *batch[BATCH_MAX_PACKETS];
+    unsigned int num;
+
+    spoolQueue();
+
+    num = spoolPeek(&spool, records, ARRAY_SIZE(records));
+    for (unsigned int i = 0; i < num; i++) {
+        batch[i] = &records[i];
+    }
+    if (num == 0 || publishPackets(batch, num)) {
+        return 1;
+    }
+
+    spoolConsume(&spool, num);
+    if (getSpoolSize(&spool) == 0) {
+        logMessage(LOG_LEVEL_INFO, LOG_CLASS_PUBLISH, "Sent all spooled readings, %llu were lost.",
+                   getSpoolDropped(&spool));
+    }
+    return 0;
+}
+
+/* Waits before the next publish attempt, doubling the wait each time up to
+ * PUBLISH_BACKOFF_MAX. Readings that arrive meanwhile are spooled so the
+ * queue never overflows while waiting.
+ */
+void waitBackoff(int *backoff) {
+    struct timespec sleepTime;
+
+    if (useSpool) {
+        waitQueue(&packetQueue, PACKET_QUEUE_SIZE / 2, *backoff);
+        spoolQueue();
+    } else {
+        sleepTime.tv_sec = *backoff / 1000;
+        sleepTime.tv_nsec = (*backoff % 1000) * 1000000L;
+        nanosleep(&sleepTime, NULL);
+    }
+
+    *backoff *= 2;
+    if (*backoff > PUBLISH_BACKOFF_MAX) {
+        *backoff = PUBLISH_BACKOFF_MAX;
+    }
+}
+
+/* Prints the reason for a failed publish.
+ * Returns 0 if the publish succeeded; otherwise non-zero.
+ */
+int checkPublish(int ret) {
+    if (ret == MOSQ_ERR_INVAL) {
+        logMessage(LOG_LEVEL_ERROR, LOG_CLASS_PUBLISH, "Error sending message - Invalid parameters.");
+    } else if (ret == MOSQ_ERR_NO_CONN) {
+        logMessage(LOG_LEVEL_ERROR, LOG_CLASS_PUBLISH, "Error sending message - No connection.");
+    } else if (ret == MOSQ_ERR_PROTOCOL) {
+        logMessage(LOG_LEVEL_ERROR, LOG_CLASS_PUBLISH, "Error sending message - Protocol error.");
+    } else if (ret == MOSQ_ERR_PAYLOAD_SIZE) {
+        logMessage(LOG_LEVEL_ERROR, LOG_CLASS_PUBLISH, "Error sending message - Payload too large.");
+    } else {
+        return 0;
+    }
+    publishFailures++;
+    return 1;
+}
+
+/* Encodes the given packets in the selected wire format.
+ * Returns the length of the encoded message.
+ */
+int encodePackets(struct wisnPacket **packets, unsigned int num, char *buffer, int size) {
+    if (useColumnar) {
+        return serialiseColumnar(packets, num, (unsigned char *)buffer, size);
+    } else if (useBinary) {
+        return serialiseWisnPackets(packets, num, (unsigned char *)buffer, size);
+    } else if (num == 1) {
+        JSONisePacket(packets[0], buffer, size);
+    } else {
+        JSONiseBatch(packets, num, buffer, size);
+    }
+    return strlen(buffer);
+}
+
 /* Turns the given packet into a JSON structure.
  */
 void JSONisePacket(struct wisnPacket *packet, char *buffer, int size) {
     memset(buffer, 0, size);
 
     snprintf(buffer, size,
-            "{\"node\":%d,\"time\":%llu,\"mac\":\"%02X%02X%02X%02X%02X%02X\",\"rssi\":%f}",
+            "{\"node\":%d,\"time\":%llu,\"mac\":\"%02X%02X%02X%02X%02X%02X\",\"rssi\":%f,\"sd\":%.1f}",
             packet->nodeNum, packet->timestamp, packet->mac[0], packet->mac[1],
-            packet->mac[2], packet->mac[3], packet->mac[4], packet->mac[5], packet->rssi);
+            packet->mac[2], packet->mac[3], packet->mac[4], packet->mac[5], packet->rssi,
+            packet->rssiDeviation);
+}
+
+/* Turns the given packets into a JSON array of packet structures.
+ */
+void JSONiseBatch(struct wisnPacket **packets, unsigned int num, char *buffer, int size) {
+    int length = 1;
+
+    memset(buffer, 0, size);
+    buffer[0] = '[';
+
+    for (unsigned int i = 0; i < num && length < size - 2; i++) {
+        if (i > 0) {
+            buffer[length++] = ',';
+        }
+        JSONisePacket(packets[i], buffer + length, size - length - 1);
+        length += strlen(buffer + length);
+    }
+
+    buffer[length] = ']';
+}
+
+/* Thread for periodically publishing runtime statistics of the client.
+ * Counters are only written by the thread that owns them, so reads here may
+ * be a frame or two behind.
+ */
+void *publishStats(void *arg) {
+    char buffer[STATS_BUFFER_SIZE];
+    struct timespec sleepTime;
+
+    while (isPcapOpen) {
+        sleepTime.tv_sec = statsInterval;
+        sleepTime.tv_nsec = 0;
+        sleepFor(&sleepTime);
+
+        updateKernelDrops();
+        JSONiseStats(buffer, ARRAY_SIZE(buffer));
+        mosquitto_publish(mosqConn, NULL, statsTopic, strlen(buffer), buffer, 0, 0);
+    }
+
+    pthread_exit(NULL);
+}
+
+/* Reads how many frames the kernel dropped on each radio since capture started.
+ */
+void updateKernelDrops(void) {
+    struct pcap_stat pcapStats;
+
+    for (unsigned int i = 0; i < numRadios; i++) {
+        if (!radios[i].isOpen) {
+            continue;
+        }
+        if (usePcap) {
+            if (pcap_stats(radios[i].pcapHandle, &pcapStats) == 0) {
+                radios[i].stats.kernelDrops = pcapStats.ps_drop + pcapStats.ps_ifdrop;
+            }
+        } else {
+            for (unsigned int j = 0; j < radios[i].numWorkers; j++) {
+                radios[i].stats.kernelDrops += getRingDrops(&radios[i].workers[j].captureRing);
+            }
+        }
+    }
+}
+
+/* Turns the current runtime statistics into a JSON structure.
+ */
+void JSONiseStats(char *buffer, int size) {
+    unsigned int devices = 0;
+    unsigned long evictedIdle = 0;
+    unsigned long evictedCap = 0;
+    unsigned long unchanged = 0;
+    int length;
+
+    //Read without the shard locks, counts that are a frame out don't matter here
+    for (unsigned int i = 0; i < numWorkers; i++) {
+        devices += getMacTableSize(&shards[i].devices);
+        evictedIdle += shards[i].idleEvictions;
+        evictedCap += shards[i].capEvictions;
+        unchanged += shards[i].unchangedReadings;
+    }
+
+    memset(buffer, 0, size);
+    length = snprintf(buffer, size,
+            "{\"node\":%u,\"time\":%llu,\"devices\":%u,\"evictedIdle\":%lu,\"evictedCap\":%lu,"
+            "\"unchanged\":%lu,\"queue\":%lu,\"queueDropped\":%lu,\"published\":%lu,"
+            "\"publishFailures\":%lu,\"spooled\":%llu,\"spoolDropped\":%llu,\"poolMallocs\":%lu,"
+            "\"radios\":[",
+            nodeNum, (unsigned long long)time(NULL), devices, evictedIdle, evictedCap, unchanged,
+            getQueueSize(&packetQueue), getQueueDropped(&packetQueue), published, publishFailures,
+            getSpoolSize(&spool), getSpoolDropped(&spool),
+            getPoolMallocs(&packetPool) + getPoolMallocs(&devicePool));
+
+    for (unsigned int i = 0; i < numRadios && length < size; i++) {
+        struct radioStats *stats = &radios[i].stats;
+        struct workerStats totals = {0};
+        unsigned long layoutMisses = 0;
+
+        for (unsigned int j = 0; j < radios[i].numWorkers; j++) {
+            struct captureWorker *worker = &radios[i].workers[j];
+
+            totals.filtered += worker->stats.filtered;
+            totals.unregistered += worker->stats.unregistered;
+            for (int k = 0; k < NUMCHANNELS; k++) {
+                totals.channelFrames[k] += worker->stats.channelFrames[k];
+            }
+            layoutMisses += worker->radiotapCache.misses;
+        }
+
+        length += snprintf(buffer + length, size - length,
+                "%s{\"if\":\"%s\",\"filtered\":%lu,\"kernelDrops\":%lu,\"switches\":%lu,"
+                "\"switchMs\":%llu,\"layoutMisses\":%lu,\"unregistered\":%lu,\"frames\":[",
+                i > 0 ? "," : "", radios[i].interface, totals.filtered, stats->kernelDrops,
+                stats->switches, stats->switchMicros / 1000, layoutMisses,
+                totals.unregistered);
+        for (int j = 0; j < NUMCHANNELS && length < size; j++) {
+            length += snprintf(buffer + length, size - length, "%s%lu", j > 0 ? "," : "",
+                    totals.channelFrames[j]);
+        }
+        if (length < size) {
+            length += snprintf(buffer + length, size - length, "]}");
+        }
+    }
+
+    if (length < size) {
+        snprintf(buffer + length, size - length, "]}");
+    }
 }
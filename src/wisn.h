@@ -3,14 +3,18 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <time.h>
+#include <sys/time.h>
 #include <math.h>
 
 #include <signal.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <ifaddrs.h>
+#include <limits.h>
+#include <net/if.h>
 #include <pthread.h>
 #include <pcap.h>
 
@@ -18,34 +22,216 @@
 #include "wisn_version.h"
 #include "radiotap.h"
 #include "radiotap_iter.h"
+#include "radiotap_cache.h"
 #include "ieee80211.h"
-#include "linked_list.h"
+#include "ring_queue.h"
+#include "capture_ring.h"
+#include "capture_file.h"
+#include "traffic_gen.h"
+#include "spool.h"
+#include "wifi_control.h"
+#include "rssi_average.h"
+#include "channel_scheduler.h"
+#include "timer_wheel.h"
+#include "mac_filter.h"
+#include "object_pool.h"
+#include "mac_table.h"
+#include "wisn_log.h"
 #include "mqtt.h"
-#include "khash.h"
+
+//Sizes the static build overrides from the Makefile
+#ifndef MAX_RADIOS
+#define MAX_RADIOS 4
+#endif
+#ifndef MAX_WORKERS
+#define MAX_WORKERS 8           //Most capture threads sharing one interface
+#endif
+#ifndef PACKET_QUEUE_SIZE
+#define PACKET_QUEUE_SIZE 4096  //Readings held while waiting to be sent
+#endif
+#ifndef MAX_DEVICES
+#define MAX_DEVICES 20000       //Default most devices tracked at once
+#endif
+#ifndef REGISTERED_MAX         //Most registered devices the client will filter on
+#ifdef WISN_STATIC
+#define REGISTERED_MAX MAC_FILTER_STATIC_MAX
+#else
+#define REGISTERED_MAX MAC_FILTER_MAX
+#endif
+#endif
+
+//The static build sizes everything at compile time and allocates nothing after startup,
+//so the device limit can only be lowered and registered filters live in fixed buffers
+#ifdef WISN_STATIC
+#define DEVICE_LIMIT MAX_DEVICES
+#else
+#define DEVICE_LIMIT INT_MAX
+#endif
 
 #define NUMCHANNELS 14
-#define AVGTIMEOUT 300
-#define AVGNUM 32
+#define STATS_INTERVAL 60       //Default seconds between statistics messages
+#define STATS_BUFFER_SIZE 2048
+#define DWELL_TIME 250          //Default milliseconds in each channel slot
+#define MIN_DWELL_TIME 20
+#define MAX_DWELL_TIME 60000
+#define SCHED_REPORT_SLOTS 1000 //Channel rates are logged after this many slots on a channel
+#define STATE_FILE "/var/tmp/wisn_channels"  //Default file keeping channel rates across restarts
+#define STATE_HEADER "wisn channel state 1"
+#define STATE_SAVE_INTERVAL 300 //Seconds between saves of the channel rates
+#define IDLE_TIMEOUT AVGTIMEOUT //Default seconds a device can go unheard, by then it has no readings
+#define REPLAY_DRAIN_TIME 2000  //Milliseconds to wait for readings to be sent after a replay
+#define MAX_SILENCE 8           //Default seconds between reports of a steady device, under the
+                                //server's reading timeout so it never forgets the device
+#define CAPTURE_SNAPLEN 128     //Enough for radiotap plus the 802.11 header on common drivers
+#define MIN_SNAPLEN 64
+#define CAPTURE_FILTER "not (type mgt subtype beacon) and not (type ctl subtype ack) " \
+                       "and not (type ctl subtype cts)"
+
+#define MAX_BATCH_TIME 10000   //Longest a reading can wait in a batch in milliseconds
+#define BATCH_MAX_PACKETS 64    //Most readings sent in a single message
+#define BATCH_BUFFER_SIZE (BATCH_MAX_PACKETS * 128)
+//Enough packets to fill the queue, a batch and every thread's cache
+#define PACKET_POOL_SIZE (PACKET_QUEUE_SIZE + BATCH_MAX_PACKETS + \
+                          (MAX_RADIOS * MAX_WORKERS + 1) * POOL_CACHE_SIZE)
+#define SPOOL_FILE "/var/tmp/wisn_spool"    //Default file readings wait in for the broker
+#ifndef SPOOL_SIZE
+#define SPOOL_SIZE 16           //Default megabytes in the spool file, RAM where /var/tmp is tmpfs
+#endif
+#define PUBLISH_BACKOFF_MIN 100 //Milliseconds before retrying a failed publish, doubling each time
+#define PUBLISH_BACKOFF_MAX (RECONNECTDELAY * 1000)
+
+enum argState {ARG_NONE, ARG_PORT, ARG_BROKER, ARG_CHANNEL, ARG_FILTER, ARG_SNAPLEN, ARG_BATCH,
+               ARG_INTERFACE, ARG_STATS, ARG_LOG, ARG_DWELL, ARG_STATE,
+               ARG_IDLE, ARG_DEVICES, ARG_DEADBAND, ARG_SILENCE,
+               ARG_RECORD, ARG_RECORD_SIZE, ARG_REPLAY, ARG_GENERATE,
+               ARG_SPOOL, ARG_SPOOL_SIZE, ARG_ESTIMATOR, ARG_WORKERS};
+
+//Struct for everything the client tracks about one device
+struct deviceState {
+    struct rssiAverage readings;
+    unsigned long long mac;     //Key of the device in the maps
+    time_t lastSeen;
+    double sentAverage;         //Estimate in the last reading reported to the server
+    time_t lastSent;            //Time of the last reading reported, only set once isReported
+    char isReported;
+    struct wheelEntry expiry;   //Checked for being idle when it comes round
+    unsigned int seenSlot[MAX_RADIOS];  //Last channel slot of each radio the device was counted in
+};
+
+//Struct for the devices whose frames one capture worker of each radio handles
+//Only locked when several radios share it; with one radio a single thread owns it
+struct deviceShard {
+    struct macTable devices;    //State of each device, sized for maxDevices up front
+    struct timerWheel deviceWheel;  //Expires devices that have not been heard for a while
+    pthread_mutex_t mutex;
+    char isShared;
+    unsigned int maxDevices;    //This shard's part of the device cap
+    unsigned long idleEvictions;
+    unsigned long capEvictions;
+    unsigned long unchangedReadings;
+    char pad[QUEUE_CACHE_LINE]; //Keeps shards used by different cores off each other's cache lines
+};
+
+//Struct for counters kept by a capture worker
+struct workerStats {
+    unsigned long channelFrames[NUMCHANNELS];   //Frames accepted on each channel
+    unsigned long filtered;                     //Frames discarded after capture
+    unsigned long unregistered;                 //Frames from devices not registered with the server
+};
+
+//Struct for counters kept by a radio's channel switcher and statistics threads
+struct radioStats {
+    unsigned long kernelDrops;                  //Frames the kernel had no room for
+    unsigned long switches;                     //Channel changes
+    unsigned long long switchMicros;            //Time spent changing channel
+};
+
+//Struct for one capture socket of a radio and everything only its thread changes
+struct captureWorker {
+    struct radio *radio;
+    struct captureRing captureRing;
+    struct radiotapCache radiotapCache;     //Field offsets of the radiotap layouts seen recently
+    struct poolCache packetCache;           //Packets for readings from this worker
+    struct deviceShard *shard;              //Devices whose frames this worker is given
+    struct workerStats stats;
+    pthread_t thread;
+    char isThreadRunning;
+    char pad[QUEUE_CACHE_LINE];
+};
 
-enum argState {ARG_NONE, ARG_PORT, ARG_BROKER, ARG_CHANNEL};
+//Struct for a wifi interface with its capture handle and channel plan
+struct radio {
+    char *interface;
+    pcap_t *pcapHandle;
+    struct captureWorker workers[MAX_WORKERS];  //Sockets in the interface's fanout group
+    unsigned int numWorkers;
+    struct captureRecorder recorder;        //Writes captured frames to files when recording
+    char isOpen;
+    pthread_t channelThread;
+    char isChannelThreadRunning;
+    unsigned char channels[NUMCHANNELS];    //Channels this radio listens on
+    unsigned int numChannels;
+    volatile unsigned int channelIndex;     //Index of the current channel in the plan
+    struct channelScheduler scheduler;      //Chooses the channel for each slot
+    volatile unsigned int slot;             //Unique number of the current channel slot
+    volatile unsigned int slotDevices;      //Distinct devices heard in the current slot
+    struct radioStats stats;
+};
 
 int main(int argc, char *argv[]);
+int parseRadio(char *arg, struct radio *radio);
+void pcapLoop(struct captureWorker *worker);
+void *captureLoop(void *arg);
+void replayCapture(struct radio *radio);
+void generateCapture(struct radio *radio);
 //int runCommand(char *command, char **args);
 int runCommand(const char *command, char *arg);
 void cleanup(int ret);
+void stopCapture(int sig);
 void destroyStoredData(void);
-pcap_t* initialisePcap(char *device);
+pcap_t* initialisePcap(struct radio *radio);
 void closePcap(pcap_t *pcapHandle);
+int initialiseRing(struct radio *radio);
+int bringInterface(char *device, char up);
+void closeCapture(struct radio *radio);
 void readPacket(u_char *args, const struct pcap_pkthdr *header, const u_char *packet);
-void changeChannel(char channel);
+int initShard(struct deviceShard *shard, unsigned int maxDevices, char isShared, time_t now);
+void destroyShard(struct deviceShard *shard);
+void lockShard(struct deviceShard *shard);
+void unlockShard(struct deviceShard *shard);
+void expireDevice(struct wheelEntry *entry, void *arg);
+void evictDevice(struct deviceShard *shard);
+void removeDevice(struct deviceShard *shard, struct deviceState *device);
+void changeChannel(struct radio *radio, char channel);
 char getChannel(short frequency);
 void* channelSwitcher(void *arg);
-void calculateChannelTimeSlices(time_t *channelTime);
+void sleepFor(struct timespec *sleepTime);
+void logChannelRates(struct radio *radio);
+int loadChannelState(void);
+int saveChannelState(void);
 char compareMAC(const unsigned char *mac1, const unsigned char *mac2);
 char checkInterface();
-unsigned char *serialiseWisnPacket(struct wisnPacket *packet, unsigned int *size);
-void signalList(struct linkedList *list);
 unsigned int connectToBroker(char *address, unsigned int baseNum, int port);
+void freePacket(void *packet);
+void connectedToBroker(struct mosquitto *conn, void *args, int result);
+void receivedMessage(struct mosquitto *conn, void *args, const struct mosquitto_message *message);
+void updateRegisteredFilter(const unsigned char *payload, int length);
+struct macFilter *readRegisteredFilter(const unsigned char *payload, int length);
+void releaseRegisteredFilter(struct macFilter *filter);
+char isRegistered(const unsigned char *mac);
 void *sendToServer(void *arg);
+void *sendBatchesToServer(void *arg);
+int publishPackets(struct wisnPacket **packets, unsigned int num);
+char isSpooling(void);
+void spoolPackets(struct wisnPacket **packets, unsigned int num);
+void spoolQueue(void);
+int drainSpool(void);
+void waitBackoff(int *backoff);
+int checkPublish(int ret);
+int encodePackets(struct wisnPacket **packets, unsigned int num, char *buffer, int size);
 void JSONisePacket(struct wisnPacket *packet, char *buffer, int size);
+void JSONiseBatch(struct wisnPacket **packets, unsigned int num, char *buffer, int size);
+void *publishStats(void *arg);
+void updateKernelDrops(void);
+void JSONiseStats(char *buffer, int size);
 #endif
@@ -0,0 +1,150 @@
+#include "wisn_gen.h"
+
+const char *usage = "Usage: wisn_gen -o file [OPTIONS]\n\n"
+                    "-o file\t\tpcap file to write the frames to\n"
+                    "-n frames\tFrames to generate\n"
+                    "-d devices\tTransmitters heard\n"
+                    "-a aps\t\tAccess points sending beacons\n"
+                    "-b ratio\tFraction of frames that are beacons\n"
+                    "-m d,p,c\tRelative amounts of data, probe request and control frames\n"
+                    "-r min,max\tRange of mean RSSI in dBm for each transmitter\n"
+                    "-s dB\t\tStandard deviation of RSSI around each transmitter's mean\n"
+                    "-f fps\t\tFrames per second the timestamps are spaced at\n"
+                    "-S seed\t\tSeed for the generated traffic\n"
+                    "-v\t\twisn_gen version\n";     //Usage string
+
+/* Generates synthetic radiotap traffic into a pcap file, which wisn can replay
+ * with -o to benchmark its processing without a radio.
+ */
+int main(int argc, char *argv[]) {
+    struct trafficConfig config;
+    struct trafficGenerator generator;
+    struct timeval start;
+    char *output = NULL;
+    unsigned long frames = GEN_FRAMES;
+    enum argState state = ARG_NONE;
+
+    initTrafficConfig(&config);
+
+    for (int i = 1; i < argc; i++) {
+        if (state == ARG_NONE) {
+            if (strcmp(argv[i], "-o") == 0) {
+                state = ARG_OUTPUT;
+            } else if (strcmp(argv[i], "-n") == 0) {
+                state = ARG_FRAMES;
+            } else if (strcmp(argv[i], "-d") == 0) {
+                state = ARG_DEVICES;
+            } else if (strcmp(argv[i], "-a") == 0) {
+                state = ARG_ACCESS_POINTS;
+            } else if (strcmp(argv[i], "-b") == 0) {
+                state = ARG_BEACONS;
+            } else if (strcmp(argv[i], "-m") == 0) {
+                state = ARG_MIX;
+            } else if (strcmp(argv[i], "-r") == 0) {
+                state = ARG_RSSI;
+            } else if (strcmp(argv[i], "-s") == 0) {
+                state = ARG_SPREAD;
+            } else if (strcmp(argv[i], "-f") == 0) {
+                state = ARG_RATE;
+            } else if (strcmp(argv[i], "-S") == 0) {
+                state = ARG_SEED;
+            } else if (strcmp(argv[i], "-v") == 0) {
+                printf("\n%s\n", WISN_VERSION);
+                return 0;
+            } else {
+                printf("\n%s\n", usage);
+                return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+            }
+        } else {
+            if (state == ARG_OUTPUT) {
+                output = argv[i];
+            } else if (state == ARG_FRAMES) {
+                frames = strtoul(argv[i], NULL, 10);
+            } else if (state == ARG_DEVICES) {
+                config.devices = strtoul(argv[i], NULL, 10);
+            } else if (state == ARG_ACCESS_POINTS) {
+                config.accessPoints = strtoul(argv[i], NULL, 10);
+            } else if (state == ARG_BEACONS) {
+                config.beaconRatio = strtod(argv[i], NULL);
+            } else if (state == ARG_MIX) {
+                if (sscanf(argv[i], "%lf,%lf,%lf", &config.dataWeight, &config.probeWeight,
+                           &config.controlWeight) != 3) {
+                    fprintf(stderr, "Invalid frame mix\n");
+                    return 1;
+                }
+            } else if (state == ARG_RSSI) {
+                if (sscanf(argv[i], "%d,%d", &config.rssiMin, &config.rssiMax) != 2) {
+                    fprintf(stderr, "Invalid RSSI range\n");
+                    return 1;
+                }
+            } else if (state == ARG_SPREAD) {
+                config.rssiSpread = strtod(argv[i], NULL);
+            } else if (state == ARG_RATE) {
+                config.framesPerSecond = strtoul(argv[i], NULL, 10);
+            } else if (state == ARG_SEED) {
+                config.seed = strtoul(argv[i], NULL, 10);
+            }
+            state = ARG_NONE;
+        }
+    }
+
+    if (output == NULL) {
+        fprintf(stderr, "%s", usage);
+        return 1;
+    }
+
+    gettimeofday(&start, NULL);
+    if (initGenerator(&generator, &config, &start)) {
+        return 2;
+    }
+
+    if (writeFrames(&generator, output, frames)) {
+        destroyGenerator(&generator);
+        return 3;
+    }
+
+    destroyGenerator(&generator);
+    return 0;
+}
+
+/* Writes the given number of generated frames to a pcap file and reports how
+ * long generating them took.
+ * Returns 0 on success; otherwise non-zero.
+ */
+int writeFrames(struct trafficGenerator *generator, const char *path, unsigned long frames) {
+    pcap_t *deadHandle;
+    pcap_dumper_t *dumper;
+    struct pcap_pkthdr header;
+    u_char buffer[GEN_FRAME_SIZE];
+    struct timespec start;
+    struct timespec end;
+    double seconds;
+
+    deadHandle = pcap_open_dead(DLT_IEEE802_11_RADIO, GEN_FRAME_SIZE);
+    if (deadHandle == NULL) {
+        fprintf(stderr, "Error creating pcap handle.\n");
+        return 1;
+    }
+    dumper = pcap_dump_open(deadHandle, path);
+    if (dumper == NULL) {
+        fprintf(stderr, "Error opening %s: %s\n", path, pcap_geterr(deadHandle));
+        pcap_close(deadHandle);
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned long i = 0; i < frames; i++) {
+        generateFrame(generator, &header, buffer);
+        pcap_dump((u_char *)dumper, &header, buffer);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    pcap_dump_close(dumper);
+    pcap_close(deadHandle);
+
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("Wrote %lu frames covering %.1f s to %s in %.3f s, %.0f frames/s.\n", frames,
+           (double)frames / generator->config.framesPerSecond, path, seconds,
+           seconds > 0.0 ? frames / seconds : 0.0);
+    return 0;
+}
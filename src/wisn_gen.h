@@ -0,0 +1,23 @@
+#ifndef WISN_GEN
+#define WISN_GEN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/time.h>
+#include <pcap.h>
+
+#include "wisn_version.h"
+#include "traffic_gen.h"
+
+#define GEN_FRAMES 1000000      //Default frames to generate
+
+enum argState {ARG_NONE, ARG_OUTPUT, ARG_FRAMES, ARG_DEVICES, ARG_ACCESS_POINTS, ARG_BEACONS,
+               ARG_MIX, ARG_RSSI, ARG_SPREAD, ARG_RATE, ARG_SEED};
+
+int main(int argc, char *argv[]);
+int writeFrames(struct trafficGenerator *generator, const char *path, unsigned long frames);
+
+#endif
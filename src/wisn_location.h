@@ -1,7 +1,10 @@
 #ifndef WISN_LOCATION
 #define WISN_LOCATION
 
+#include "slab_list.h"
+
 struct wisnLocation {
+    struct slabLink link;   //Links the location into its device's list
     unsigned long long mac;
     double x;
     double y;
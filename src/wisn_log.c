@@ -0,0 +1,198 @@
+#include "wisn_log.h"
+
+struct logLimit logLimits[LOG_CLASS_NUM] = {
+    {"general", 0, 0, 0, 0},
+    {"frame", 20, 0, 0, 0},
+    {"channel", 10, 0, 0, 0},
+    {"publish", 5, 0, 0, 0},
+    {"position", 50, 0, 0, 0}
+};
+
+struct logEntry logEntries[LOG_QUEUE_SIZE]; //Storage for every message, nothing is allocated
+struct ringQueue freeEntries;               //Entries ready to be written to
+struct ringQueue pendingEntries;            //Entries waiting for the drain thread
+pthread_t logThread;                        //Thread writing out pending entries
+enum logLevel logLevel = LOG_LEVEL_INFO;    //Most verbose level written
+volatile char isLogRunning = 0;             //Flag for if messages go through the drain thread
+unsigned long logDropped;                   //Messages lost because every entry was in use
+time_t logCachedTime;                       //Second the cached timestamp string is for
+char logTimeString[16];                     //Cached timestamp string
+
+//Sets the log level and starts the thread that writes messages out
+//Until this is called messages are written directly
+//Returns 0 on success; otherwise -1
+int initLog(enum logLevel level) {
+    logLevel = level;
+
+    if (initQueue(&freeEntries, LOG_QUEUE_SIZE, QUEUE_DROP_NEWEST, NULL)) {
+        return -1;
+    }
+    if (initQueue(&pendingEntries, LOG_QUEUE_SIZE, QUEUE_DROP_NEWEST, NULL)) {
+        destroyQueue(&freeEntries);
+        return -1;
+    }
+    for (int i = 0; i < LOG_QUEUE_SIZE; i++) {
+        enqueue(&freeEntries, &logEntries[i]);
+    }
+
+    isLogRunning = 1;
+    if (pthread_create(&logThread, NULL, drainLog, NULL)) {
+        fprintf(stderr, "Error starting log thread.\n");
+        isLogRunning = 0;
+        destroyQueue(&pendingEntries);
+        destroyQueue(&freeEntries);
+        return -1;
+    }
+
+    return 0;
+}
+
+//Writes out any pending messages and stops the drain thread
+void stopLog(void) {
+    void *status;
+
+    if (!isLogRunning) {
+        return;
+    }
+
+    isLogRunning = 0;
+    wakeQueue(&pendingEntries);
+    pthread_join(logThread, &status);
+    destroyQueue(&pendingEntries);
+    destroyQueue(&freeEntries);
+}
+
+//Formats a message and queues it for the drain thread
+//Messages above the log level or over their class's rate limit are discarded
+void logMessage(enum logLevel level, enum logClass class, const char *format, ...) {
+    struct logEntry *entry;
+    struct logEntry direct;
+    va_list args;
+    time_t now;
+
+    if (!isLogLevelEnabled(level)) {
+        return;
+    }
+
+    now = time(NULL);
+    if (!checkLogLimit(class, now)) {
+        return;
+    }
+
+    if (isLogRunning) {
+        entry = dequeue(&freeEntries);
+        if (entry == NULL) {    //Drain thread is behind, lose this message
+            __atomic_add_fetch(&logDropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } else {
+        entry = &direct;
+    }
+
+    entry->time = now;
+    entry->level = level;
+    va_start(args, format);
+    vsnprintf(entry->text, LOG_LINE_SIZE, format, args);
+    va_end(args);
+
+    if (entry == &direct) {
+        writeLogEntry(entry);
+    } else {
+        enqueue(&pendingEntries, entry);
+    }
+}
+
+//Returns non-zero if messages of the given level are written; otherwise 0
+char isLogLevelEnabled(enum logLevel level) {
+    return level <= logLevel;
+}
+
+//Counts a message against its class's limit for the current second
+//Returns non-zero if the message may be written; otherwise 0
+char checkLogLimit(enum logClass class, time_t now) {
+    struct logLimit *limit = &logLimits[class];
+    time_t window;
+
+    if (limit->perSecond == 0) {
+        return 1;
+    }
+
+    //First message of a new second resets the count
+    window = __atomic_load_n(&limit->window, __ATOMIC_RELAXED);
+    if (window != now && __atomic_compare_exchange_n(&limit->window, &window, now, 0,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&limit->count, 0, __ATOMIC_RELAXED);
+    }
+
+    if (__atomic_add_fetch(&limit->count, 1, __ATOMIC_RELAXED) > limit->perSecond) {
+        __atomic_add_fetch(&limit->suppressed, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    return 1;
+}
+
+//Thread for writing queued messages out
+//Only returns when stopLog is called
+void *drainLog(void *arg) {
+    struct logEntry *entries[LOG_QUEUE_SIZE];
+    unsigned int num;
+
+    do {
+        waitQueue(&pendingEntries, 1, LOG_DRAIN_TIMEOUT);
+
+        num = dequeueBatch(&pendingEntries, (void **)entries, LOG_QUEUE_SIZE);
+        for (unsigned int i = 0; i < num; i++) {
+            writeLogEntry(entries[i]);
+            enqueue(&freeEntries, entries[i]);
+        }
+        if (num > 0) {
+            fflush(stdout);
+        }
+
+        reportSuppressed();
+    } while (isLogRunning || getQueueSize(&pendingEntries) > 0);
+
+    pthread_exit(NULL);
+}
+
+//Writes a message with its timestamp. Only one thread may call this at a time.
+//The timestamp string is cached and only formatted again when the second changes.
+void writeLogEntry(struct logEntry *entry) {
+    struct tm tmInfo;
+
+    if (entry->time != logCachedTime) {
+        logCachedTime = entry->time;
+        localtime_r(&logCachedTime, &tmInfo);
+        strftime(logTimeString, sizeof(logTimeString), "%X", &tmInfo);
+    }
+
+    if (entry->level <= LOG_LEVEL_WARN) {
+        fprintf(stderr, "%s %s\n", logTimeString, entry->text);
+    } else {
+        fprintf(stdout, "%s %s\n", logTimeString, entry->text);
+    }
+}
+
+//Writes how many messages of each class were discarded since the last report
+void reportSuppressed(void) {
+    struct logEntry entry;
+    unsigned long suppressed;
+
+    entry.time = time(NULL);
+    entry.level = LOG_LEVEL_INFO;
+
+    for (int i = 0; i < LOG_CLASS_NUM; i++) {
+        suppressed = __atomic_exchange_n(&logLimits[i].suppressed, 0, __ATOMIC_RELAXED);
+        if (suppressed > 0) {
+            snprintf(entry.text, LOG_LINE_SIZE, "%lu %s messages suppressed", suppressed,
+                     logLimits[i].name);
+            writeLogEntry(&entry);
+        }
+    }
+
+    suppressed = __atomic_exchange_n(&logDropped, 0, __ATOMIC_RELAXED);
+    if (suppressed > 0) {
+        snprintf(entry.text, LOG_LINE_SIZE, "%lu messages lost with log queue full", suppressed);
+        writeLogEntry(&entry);
+    }
+}
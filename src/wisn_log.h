@@ -0,0 +1,50 @@
+#ifndef WISN_LOG
+#define WISN_LOG
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "ring_queue.h"
+
+#define LOG_QUEUE_SIZE 512      //Messages that can wait to be written
+#define LOG_LINE_SIZE 256       //Longest message, longer ones are truncated
+#define LOG_DRAIN_TIMEOUT 1000  //Milliseconds between checks for suppressed messages
+
+//Severity of a message, messages above the configured level are discarded
+enum logLevel {LOG_LEVEL_ERROR, LOG_LEVEL_WARN, LOG_LEVEL_INFO, LOG_LEVEL_DEBUG};
+
+//Kind of message, each kind is rate limited separately
+enum logClass {LOG_CLASS_GENERAL, LOG_CLASS_FRAME, LOG_CLASS_CHANNEL, LOG_CLASS_PUBLISH,
+               LOG_CLASS_POSITION, LOG_CLASS_NUM};
+
+//Struct for a message waiting to be written
+struct logEntry {
+    time_t time;
+    enum logLevel level;
+    char text[LOG_LINE_SIZE];
+};
+
+//Struct for the rate limit of one message class
+struct logLimit {
+    const char *name;
+    unsigned int perSecond;         //Messages allowed each second, 0 for unlimited
+    volatile time_t window;         //Second the count applies to
+    volatile unsigned int count;
+    volatile unsigned long suppressed;
+};
+
+int initLog(enum logLevel level);
+void stopLog(void);
+void logMessage(enum logLevel level, enum logClass class, const char *format, ...)
+        __attribute__((format(printf, 3, 4)));
+char isLogLevelEnabled(enum logLevel level);
+char checkLogLimit(enum logClass class, time_t now);
+void *drainLog(void *arg);
+void writeLogEntry(struct logEntry *entry);
+void reportSuppressed(void);
+
+#endif
@@ -1,10 +1,10 @@
 #include "wisn_packet.h"
 
 void printPacket(struct wisnPacket *wisnData) {
-    printf("Node: %d, Time: %llu, MAC: %02X:%02X:%02X:%02X:%02X:%02X, RSSI: %f\n",
+    printf("Node: %d, Time: %llu, MAC: %02X:%02X:%02X:%02X:%02X:%02X, RSSI: %f, SD: %.1f\n",
             wisnData->nodeNum, wisnData->timestamp, wisnData->mac[0], wisnData->mac[1],
             wisnData->mac[2], wisnData->mac[3], wisnData->mac[4], wisnData->mac[5],
-            wisnData->rssi);
+            wisnData->rssi, wisnData->rssiDeviation);
 }
 
 struct wisnPacket *clonePacket(struct wisnPacket *packet) {
@@ -12,6 +12,253 @@ struct wisnPacket *clonePacket(struct wisnPacket *packet) {
     newPacket->timestamp = packet->timestamp;
     memcpy(newPacket->mac, packet->mac, ARRAY_SIZE(packet->mac));
     newPacket->rssi = packet->rssi;
+    newPacket->rssiDeviation = packet->rssiDeviation;
     newPacket->nodeNum = packet->nodeNum;
     return newPacket;
 }
+
+//Writes the given packets from one node into buffer in the binary wire format
+//Returns the number of bytes written or 0 if they don't fit
+unsigned int serialiseWisnPackets(struct wisnPacket **packets, unsigned int num,
+        unsigned char *buffer, unsigned int size) {
+
+    unsigned char *marker = buffer;
+    unsigned short nodeNum;
+    unsigned long long timestamp;
+
+    if (num < 1 || num > WIRE_MAX_RECORDS ||
+            WIRE_HEADER_SIZE + num * WIRE_RECORD_SIZE > size) {
+        return 0;
+    }
+
+    *marker++ = WIRE_VERSION;
+    *marker++ = num;
+    nodeNum = htole16(packets[0]->nodeNum);
+    memcpy(marker, &nodeNum, sizeof(nodeNum));
+    marker += sizeof(nodeNum);
+
+    for (unsigned int i = 0; i < num; i++) {
+        timestamp = htole64(packets[i]->timestamp);
+        memcpy(marker, &timestamp, sizeof(timestamp));
+        marker += sizeof(timestamp);
+
+        memcpy(marker, packets[i]->mac, ARRAY_SIZE(packets[i]->mac));
+        marker += ARRAY_SIZE(packets[i]->mac);
+
+        *marker++ = encodeRSSI(packets[i]->rssi);
+    }
+
+    return marker - buffer;
+}
+
+//Checks the header of a binary wire format message
+//Returns the number of records in the message or 0 if it isn't valid
+unsigned int getWireRecordCount(const unsigned char *buffer, unsigned int size) {
+    if (size < WIRE_HEADER_SIZE || buffer[0] != WIRE_VERSION ||
+            size != WIRE_HEADER_SIZE + buffer[1] * WIRE_RECORD_SIZE) {
+        return 0;
+    }
+    return buffer[1];
+}
+
+//Reads the record at index from a binary wire format message into packet
+void deserialiseWisnPacket(const unsigned char *buffer, unsigned int index,
+        struct wisnPacket *packet) {
+
+    const unsigned char *marker = buffer + WIRE_HEADER_SIZE + index * WIRE_RECORD_SIZE;
+    unsigned short nodeNum;
+    unsigned long long timestamp;
+
+    memcpy(&nodeNum, buffer + 2, sizeof(nodeNum));
+    packet->nodeNum = le16toh(nodeNum);
+
+    memcpy(&timestamp, marker, sizeof(timestamp));
+    packet->timestamp = le64toh(timestamp);
+    marker += sizeof(timestamp);
+
+    memcpy(packet->mac, marker, ARRAY_SIZE(packet->mac));
+    marker += ARRAY_SIZE(packet->mac);
+
+    packet->rssi = *marker;
+    packet->rssiDeviation = 0.0;    //Not carried by this format
+}
+
+//Writes the given packets from one node into buffer in the columnar wire format
+//Returns the number of bytes written or 0 if they don't fit
+unsigned int serialiseColumnar(struct wisnPacket **packets, unsigned int num,
+        unsigned char *buffer, unsigned int size) {
+
+    unsigned char *marker = buffer;
+    unsigned char *end = buffer + size;
+    unsigned char indices[WIRE_MAX_RECORDS];
+    unsigned int macs[WIRE_MAX_RECORDS];    //Record holding each distinct MAC
+    unsigned int numMacs = 0;
+    unsigned short nodeNum;
+    long long delta;
+    unsigned int written;
+
+    if (num < 1 || num > WIRE_MAX_RECORDS || size < WIRE_HEADER_SIZE) {
+        return 0;
+    }
+
+    *marker++ = WIRE_VERSION_COLUMNAR;
+    *marker++ = num;
+    nodeNum = htole16(packets[0]->nodeNum);
+    memcpy(marker, &nodeNum, sizeof(nodeNum));
+    marker += sizeof(nodeNum);
+
+    //Readings in a batch are only seconds apart so deltas take a byte
+    for (unsigned int i = 0; i < num; i++) {
+        if (i == 0) {
+            written = writeVarint(marker, end - marker, packets[0]->timestamp);
+        } else {
+            delta = packets[i]->timestamp - packets[i - 1]->timestamp;
+            written = writeVarint(marker, end - marker,
+                                  ((unsigned long long)delta << 1) ^ (delta >> 63));
+        }
+        if (written == 0) {
+            return 0;
+        }
+        marker += written;
+    }
+
+    //Devices heard by several radios or repeatedly appear once in the dictionary
+    for (unsigned int i = 0; i < num; i++) {
+        unsigned int j;
+        for (j = 0; j < numMacs; j++) {
+            if (memcmp(packets[macs[j]]->mac, packets[i]->mac, ARRAY_SIZE(packets[i]->mac)) == 0) {
+                break;
+            }
+        }
+        if (j == numMacs) {
+            macs[numMacs++] = i;
+        }
+        indices[i] = j;
+    }
+
+    written = writeVarint(marker, end - marker, numMacs);
+    if (written == 0 ||
+        (unsigned int)(end - marker) < written + numMacs * ARRAY_SIZE(packets[0]->mac) + 3 * num) {
+        return 0;
+    }
+    marker += written;
+    for (unsigned int j = 0; j < numMacs; j++) {
+        memcpy(marker, packets[macs[j]]->mac, ARRAY_SIZE(packets[0]->mac));
+        marker += ARRAY_SIZE(packets[0]->mac);
+    }
+    memcpy(marker, indices, num);
+    marker += num;
+
+    for (unsigned int i = 0; i < num; i++) {
+        *marker++ = encodeRSSI(packets[i]->rssi);
+    }
+    for (unsigned int i = 0; i < num; i++) {
+        *marker++ = encodeDeviation(packets[i]->rssiDeviation);
+    }
+
+    return marker - buffer;
+}
+
+//Reads every record of a columnar wire format message into packets
+//Returns the number of records read or 0 if the message isn't valid
+unsigned int deserialiseColumnar(const unsigned char *buffer, unsigned int size,
+        struct wisnPacket *packets, unsigned int max) {
+
+    const unsigned char *marker = buffer + WIRE_HEADER_SIZE;
+    const unsigned char *end = buffer + size;
+    const unsigned char *dictionary;
+    unsigned long long value;
+    unsigned long long numMacs;
+    unsigned short nodeNum;
+    unsigned int num;
+    unsigned int read;
+
+    if (size < WIRE_HEADER_SIZE || buffer[0] != WIRE_VERSION_COLUMNAR ||
+        buffer[1] < 1 || buffer[1] > max) {
+        return 0;
+    }
+    num = buffer[1];
+    memcpy(&nodeNum, buffer + 2, sizeof(nodeNum));
+    nodeNum = le16toh(nodeNum);
+
+    for (unsigned int i = 0; i < num; i++) {
+        read = readVarint(marker, end - marker, &value);
+        if (read == 0) {
+            return 0;
+        }
+        marker += read;
+
+        if (i == 0) {
+            packets[0].timestamp = value;
+        } else {
+            packets[i].timestamp = packets[i - 1].timestamp +
+                                   (unsigned long long)((long long)(value >> 1) ^ -(long long)(value & 1));
+        }
+        packets[i].nodeNum = nodeNum;
+    }
+
+    read = readVarint(marker, end - marker, &numMacs);
+    if (read == 0 || numMacs < 1 || numMacs > num) {
+        return 0;
+    }
+    marker += read;
+    if ((unsigned long)(end - marker) != numMacs * ARRAY_SIZE(packets[0].mac) + 3 * num) {
+        return 0;
+    }
+    dictionary = marker;
+    marker += numMacs * ARRAY_SIZE(packets[0].mac);
+
+    for (unsigned int i = 0; i < num; i++) {
+        if (marker[i] >= numMacs) {
+            return 0;
+        }
+        memcpy(packets[i].mac, dictionary + marker[i] * ARRAY_SIZE(packets[i].mac),
+               ARRAY_SIZE(packets[i].mac));
+        packets[i].rssi = marker[num + i];
+        packets[i].rssiDeviation = marker[2 * num + i] / WIRE_DEVIATION_SCALE;
+    }
+
+    return num;
+}
+
+//Writes value as a little endian base 128 varint
+//Returns the number of bytes written or 0 if it doesn't fit
+unsigned int writeVarint(unsigned char *buffer, unsigned int size, unsigned long long value) {
+    unsigned int length = 0;
+
+    do {
+        if (length == size) {
+            return 0;
+        }
+        buffer[length++] = (value & 0x7F) | (value > 0x7F ? 0x80 : 0);
+        value >>= 7;
+    } while (value);
+
+    return length;
+}
+
+//Reads a little endian base 128 varint into value
+//Returns the number of bytes read or 0 if it is truncated or too long
+unsigned int readVarint(const unsigned char *buffer, unsigned int size, unsigned long long *value) {
+    *value = 0;
+
+    for (unsigned int i = 0; i < size && i < WIRE_VARINT_MAX; i++) {
+        *value |= (unsigned long long)(buffer[i] & 0x7F) << (7 * i);
+        if ((buffer[i] & 0x80) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+//Rounds an averaged RSSI into the single byte both wire formats use
+unsigned char encodeRSSI(double rssi) {
+    rssi = round(rssi);
+    return rssi < 0.0 ? 0 : (rssi > 255.0 ? 255 : (unsigned char)rssi);
+}
+
+//Scales the spread of a device's readings into one byte, clamping large spreads
+unsigned char encodeDeviation(double deviation) {
+    deviation = round(deviation * WIRE_DEVIATION_SCALE);
+    return deviation < 0.0 ? 0 : (deviation > 255.0 ? 255 : (unsigned char)deviation);
+}
@@ -4,17 +4,51 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <endian.h>
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
+//Binary wire format: a header then fixed size little endian records
+//Header:   version (1), record count (1), node number (2)
+//Record:   timestamp (8), mac (6), rssi (1)
+#define WIRE_VERSION 1
+#define WIRE_HEADER_SIZE 4
+#define WIRE_RECORD_SIZE 15
+#define WIRE_MAX_RECORDS 255
+//Columnar batches share the header but store each field together
+//Timestamps:   first as a varint, the rest as zigzag varint deltas from the one before
+//MACs:         dictionary size (varint), each distinct MAC (6), then an index per record (1)
+//RSSI:         one byte per record
+//Deviation:    one byte per record in tenths of a dB
+#define WIRE_VERSION_COLUMNAR 2
+#define WIRE_DEVIATION_SCALE 10.0
+#define WIRE_VARINT_MAX 10      //Most bytes a 64 bit varint takes
+#define WIRE_TOPIC_SUFFIX "/bin"    //Appended to a node's topic for binary messages
+#define STATS_TOPIC_SUFFIX "/stats" //Appended to a node's topic for runtime statistics
+
 struct wisnPacket {
     unsigned long long timestamp;
     unsigned char mac[6];
     double rssi;
+    double rssiDeviation;       //Standard deviation of the readings behind rssi
     unsigned short nodeNum;
 } __attribute((packed));
 
 void printPacket(struct wisnPacket *wisnData);
 struct wisnPacket *clonePacket(struct wisnPacket *packet);
+unsigned int serialiseWisnPackets(struct wisnPacket **packets, unsigned int num,
+        unsigned char *buffer, unsigned int size);
+unsigned int getWireRecordCount(const unsigned char *buffer, unsigned int size);
+void deserialiseWisnPacket(const unsigned char *buffer, unsigned int index,
+        struct wisnPacket *packet);
+unsigned int serialiseColumnar(struct wisnPacket **packets, unsigned int num,
+        unsigned char *buffer, unsigned int size);
+unsigned int deserialiseColumnar(const unsigned char *buffer, unsigned int size,
+        struct wisnPacket *packets, unsigned int max);
+unsigned int writeVarint(unsigned char *buffer, unsigned int size, unsigned long long value);
+unsigned int readVarint(const unsigned char *buffer, unsigned int size, unsigned long long *value);
+unsigned char encodeRSSI(double rssi);
+unsigned char encodeDeviation(double deviation);
 
 #endif
@@ -1,14 +1,16 @@
 #include "wisn_server.h"
 
-KHASH_MAP_INIT_INT64(devM, struct linkedList *)
-KHASH_MAP_INIT_INT64(locM, struct linkedList *)
+KHASH_MAP_INIT_INT64(devM, struct slabList *)
+KHASH_MAP_INIT_INT64(locM, struct slabList *)
 KHASH_MAP_INIT_INT(nodeM, struct wisnNode *)
 
-struct linkedList dataList; //List of data queued for processing
+struct ringQueue dataQueue; //Queue of data waiting for processing
 
 const char *usage =  "Usage: wisn_server [OPTIONS]\n\n"
                      "-b address\tMQTT Broker address or URL.\tDefault is 127.0.0.1\n"
                      "-p port\t\tMQTT port to use.\t\tDefault is 1883\n"
+                     "-t seconds\tSeconds a node's last reading of a device stays valid.\tDefault is 10\n"
+                     "-L level\tLog level: 0 errors, 1 warnings, 2 info, 3 positions.\tDefault is 2\n"
                      "-v\t\twisn_server version\n";    //Usage string
 
 struct mosquitto *mosqConn;         //MQTT connection handle
@@ -21,12 +23,12 @@ volatile char isRunning = 0;        //Flag for if data processing loop should ru
 volatile char runUpdateNodes = 0;   //Flag for updating list of nodes
 volatile char runUpdateCal = 0;     //Flag for updating calibration
 volatile char runUpdateReg = 0;     //Flag for updating registered users
-volatile char isLocked = 0;         //Flag for main loop cleanup
-volatile char isWaiting = 0;        //Flag for main loop cleanup
 
 khash_t(devM) *deviceMap;           //Hashmap for all device packet lists
 khash_t(locM) *locationMap;         //Hashmap for all device location lists
 khash_t(nodeM) *nodeMap;            //Hashmap for all node positions
+struct listSlab readingSlab;        //Readings in the device lists
+struct listSlab locationSlab;       //Positions in the location lists
 
 mongoc_client_t *dbClient;          //Database client
 mongoc_collection_t *nodesCol;      //Collection of node positions
@@ -35,14 +37,20 @@ mongoc_collection_t *calibrationCol;//Collection of calibration positions
 mongoc_collection_t *registeredCol; //Collection of registered users
 bson_t *query;                      //Empty query to get everything in a collection
 
+int readingTimeout;                 //Seconds a reading stays valid without being replaced
+unsigned int filterGeneration;      //Generation of the registered MAC set last published
+
 double pointsPerMeter;     //Calibration data for converting between meters and co-ordinates
 
 int main(int argc, char *argv[]) {
     //Signal handler for kill/termination
     struct sigaction sa;
+    int logLevel = LOG_LEVEL_INFO;
 
     mqttPort = MQTT_PORT;
     mqttBroker = MQTT_BROKER;
+    readingTimeout = TIMEOUT;
+    filterGeneration = time(NULL);  //Keeps generations changing across restarts
 
     if (argc > 1) {
         enum argState state = ARG_NONE;
@@ -58,6 +66,10 @@ int main(int argc, char *argv[]) {
                         fprintf(stderr, "\n%s\n", usage);
                         return 1;
                     }
+                } else if (strcmp(argv[i], "-L") == 0) {
+                    state = ARG_LOG;
+                } else if (strcmp(argv[i], "-t") == 0) {
+                    state = ARG_TIMEOUT;
                 } else if (strcmp(argv[i], "-v") == 0) {
                     printf("\n%s\n", WISN_VERSION);
                     return 0;
@@ -76,13 +88,33 @@ int main(int argc, char *argv[]) {
                     return 1;
                 }
                 state = ARG_NONE;
+            } else if (state == ARG_LOG) {
+                logLevel = strtol(argv[i], NULL, 10);
+                if (logLevel < LOG_LEVEL_ERROR || logLevel > LOG_LEVEL_DEBUG) {
+                    fprintf(stderr, "Invalid log level\n");
+                    fprintf(stderr, "\n%s\n", usage);
+                    return 1;
+                }
+                state = ARG_NONE;
+            } else if (state == ARG_TIMEOUT) {
+                readingTimeout = strtol(argv[i], NULL, 10);
+                if (readingTimeout < 1) {
+                    fprintf(stderr, "Invalid timeout\n");
+                    fprintf(stderr, "\n%s\n", usage);
+                    return 1;
+                }
+                state = ARG_NONE;
             }
         }
     }
 
 
-    initList(&dataList);
-    dataList.doSignal = 1;
+    initLog(logLevel);
+    if (initQueue(&dataQueue, DATA_QUEUE_SIZE, QUEUE_DROP_OLDEST, free)) {
+        return 3;
+    }
+    initListSlab(&readingSlab, sizeof(struct deviceReading));
+    initListSlab(&locationSlab, sizeof(struct wisnLocation));
     deviceMap = kh_init(devM);
     locationMap = kh_init(locM);
     nodeMap = kh_init(nodeM);
@@ -103,32 +135,14 @@ int main(int argc, char *argv[]) {
     isRunning = 1;
 
     while (isRunning) {
-        struct wisnPacket *packet;
-        struct linkedList *list;
-        struct linkedList *locList;
-
-        isLocked = 1;
-        while (pthread_mutex_lock(&(dataList.mutex)) && isRunning) { //Lock mutex to access data queue
-            fprintf(stderr, "Error acquiring list mutex.\n");
-        }
+        struct wisnPacket *packets[DATA_BATCH_SIZE];
+        unsigned int numPackets;
+        struct slabList *list;
+        struct slabList *locList;
 
-        while (dataList.head == NULL && isRunning) {    //If queue is empty, unlock mutex and wait
-            isWaiting = 1;
-            isLocked = 0;
-            if (pthread_cond_wait(&(dataList.cond), &(dataList.mutex))) {
-                fprintf(stderr, "Error waiting for condition variable signal\n");
-            }
-            isLocked = 1;
-            isWaiting = 0;
-        }
+        waitQueue(&dataQueue, 1, -1);   //Sleep until there is data or a signal arrives
 
         if (!isRunning) {
-            if (isLocked) {
-                if (pthread_mutex_unlock(&(dataList.mutex))) {
-                    fprintf(stderr, "Error releasing list mutex.\n");
-                }
-                isLocked = 0;
-            }
             break;
         }
 
@@ -145,19 +159,16 @@ int main(int argc, char *argv[]) {
             runUpdateReg = 0;
         }
 
-        packet = dataList.head->data; //Get packet to process
-        removeFromHeadList(&dataList, LIST_HAVE_LOCK, LIST_KEEP_DATA);   //Remove from data queue
-
-        if (pthread_mutex_unlock(&(dataList.mutex))) {    //Unlock mutex so new data can be added
-            fprintf(stderr, "Error releasing list mutex.\n");
-        }
-
-        //printf("Packet: ");
-        //printPacket(packet);
-        list = storeWisnPacket(packet); //Store the packet and get the list of packets for this device
-        if (list != NULL) {
-            locList = getLocationList(packet->mac); //Get the list of locations last calculated
-            localiseDevice(list, locList);   //Perform localisation for device
+        numPackets = dequeueBatch(&dataQueue, (void **)packets, ARRAY_SIZE(packets));
+        for (unsigned int i = 0; i < numPackets; i++) {
+            //printf("Packet: ");
+            //printPacket(packets[i]);
+            list = storeWisnPacket(packets[i]); //Store the packet and get the list of packets for this device
+            if (list != NULL) {
+                locList = getLocationList(packets[i]->mac); //Get the list of locations last calculated
+                localiseDevice(list, locList);   //Perform localisation for device
+            }
+            free(packets[i]);   //Stored readings are copied into the reading slab
         }
     }
 
@@ -166,16 +177,7 @@ int main(int argc, char *argv[]) {
 
 void stopRunning(int ret) {
     isRunning = 0;
-    if (isWaiting) {
-        if (pthread_cond_signal(&(dataList.cond))) {
-            fprintf(stderr, "Error signalling condition variable.\n");
-        }
-    } else if (isLocked) {
-        if (pthread_mutex_unlock(&(dataList.mutex))) {
-            fprintf(stderr, "Error releasing list mutex.\n");
-        }
-        isLocked = 0;
-    }
+    wakeQueue(&dataQueue);
 }
 
 /* Cleanup function called before exit.
@@ -194,21 +196,22 @@ void cleanup(int ret) {
     if (isDBInitialised) {
         cleanupDB();
     }
-    destroyList(&dataList, LIST_DELETE_DATA);
+    destroyQueue(&dataQueue);
     destroyStoredData();
+    stopLog();
     exit(ret);
 }
 
 /* Clean up function for deleting and freeing all lists and map data.
  */
 void destroyStoredData(void) {
-    struct linkedList *list;
+    struct slabList *list;
     struct wisnNode *node;
 
     for (khint64_t it = kh_begin(deviceMap); it != kh_end(deviceMap); it++) {
         if (kh_exist(deviceMap, it)) {
             list = kh_value(deviceMap, it);
-            destroyList(list, LIST_DELETE_DATA);
+            destroySlabList(list, LIST_DELETE_DATA);
             free(list);
         }
     }
@@ -217,11 +220,13 @@ void destroyStoredData(void) {
     for (khint64_t it = kh_begin(locationMap); it != kh_end(locationMap); it++) {
         if (kh_exist(locationMap, it)) {
             list = kh_value(locationMap, it);
-            destroyList(list, LIST_DELETE_DATA);
+            destroySlabList(list, LIST_DELETE_DATA);
             free(list);
         }
     }
     kh_destroy(locM, locationMap);
+    destroyListSlab(&readingSlab);
+    destroyListSlab(&locationSlab);
 
     for (khint_t it = kh_begin(nodeMap); it != kh_end(nodeMap); it++) {
         if (kh_exist(nodeMap, it)) {
@@ -285,8 +290,13 @@ void receivedMessage(struct mosquitto *conn, void *args,
         } else if (strcmp(EVENT_USER, message->payload) == 0) {
             runUpdateReg = 1;
         }
-    } else if (strcmp(POSITIONS_TOPIC, message->topic) == 0) {
+    } else if (strcmp(POSITIONS_TOPIC, message->topic) == 0 ||
+               strcmp(REGISTERED_TOPIC, message->topic) == 0) {
         //Ignore messages the server sends
+    } else if (hasSuffix(message->topic, STATS_TOPIC_SUFFIX)) {
+        //Ignore client statistics, they are for monitoring tools
+    } else if (hasSuffix(message->topic, WIRE_TOPIC_SUFFIX)) {
+        receivedBinaryMessage(message);
     } else {
         receivedDeviceMessage(message);
     }
@@ -296,9 +306,86 @@ void receivedMessage(struct mosquitto *conn, void *args,
  */
 void receivedDeviceMessage(const struct mosquitto_message *message) {
     struct wisnPacket *wisnData;
+    const char *payload = message->payload;
+
+    if (message->payloadlen > 0 && payload[0] == '[') { //Batch of packets
+        receivedBatchMessage(message);
+        return;
+    }
 
     wisnData = readJson(JSON_DEVICE, message->payload);
-    addDataToTailList(&dataList, wisnData);
+    enqueue(&dataQueue, wisnData);
+}
+
+/* Reads each packet in a received JSON array and queues them for processing.
+ */
+void receivedBatchMessage(const struct mosquitto_message *message) {
+    struct wisnPacket *wisnData;
+    const char *payload = message->payload;
+    const char *end = payload + message->payloadlen;
+    const char *start;
+
+    //Each record is read where it is, so records of any length are kept
+    while (payload < end) {
+        start = memchr(payload, '{', end - payload);
+        if (start == NULL) {
+            break;
+        }
+        payload = memchr(start, '}', end - start);
+        if (payload == NULL) {
+            break;
+        }
+        payload++;
+
+        wisnData = readJsonLength(JSON_DEVICE, start, payload - start);
+        enqueue(&dataQueue, wisnData);
+    }
+}
+
+/* Reads every record in a received binary message and queues them for processing.
+ */
+void receivedBinaryMessage(const struct mosquitto_message *message) {
+    struct wisnPacket *wisnData;
+    struct wisnPacket packets[WIRE_MAX_RECORDS];
+    unsigned int count;
+
+    if (message->payloadlen > 0 && *(unsigned char *)message->payload == WIRE_VERSION_COLUMNAR) {
+        count = deserialiseColumnar(message->payload, message->payloadlen, packets,
+                                    ARRAY_SIZE(packets));
+        if (count == 0) {
+            logMessage(LOG_LEVEL_WARN, LOG_CLASS_GENERAL, "Invalid columnar message on %s",
+                       message->topic);
+        }
+        for (unsigned int i = 0; i < count; i++) {
+            enqueue(&dataQueue, clonePacket(&packets[i]));
+        }
+        return;
+    }
+
+    count = getWireRecordCount(message->payload, message->payloadlen);
+
+    if (count == 0) {
+        logMessage(LOG_LEVEL_WARN, LOG_CLASS_GENERAL, "Invalid binary message on %s",
+                   message->topic);
+        return;
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        wisnData = malloc(sizeof(*wisnData));
+        deserialiseWisnPacket(message->payload, i, wisnData);
+        enqueue(&dataQueue, wisnData);
+    }
+}
+
+/* Checks if the given string ends with the given suffix.
+ * Returns non-zero if it does; otherwise 0.
+ */
+char hasSuffix(const char *string, const char *suffix) {
+    size_t stringLength = strlen(string);
+    size_t suffixLength = strlen(suffix);
+
+    return stringLength >= suffixLength &&
+           strcmp(string + stringLength - suffixLength, suffix) == 0;
 }
 
 /* Converts the MAC address from a 64 bit integer to a char array.
@@ -355,7 +442,7 @@ void stringToMAC(char *string, unsigned char *mac) {
 
 /* Attempts to localise a device from the given list of received messages.
  */
-void localiseDevice(struct linkedList *deviceList, struct linkedList *locationList) {
+void localiseDevice(struct slabList *deviceList, struct slabList *locationList) {
     double xPos;
     double yPos;
     char buffer[128];
@@ -366,14 +453,14 @@ void localiseDevice(struct linkedList *deviceList, struct linkedList *locationLi
     char havePosition = 0;
     int numNodes = 0;
 
-    pthread_mutex_lock(&deviceList->mutex);
+    lockSlabList(deviceList);
 
-    removeOldData(deviceList);  //Remove data older than 60 seconds
+    removeOldData(deviceList);  //Remove data older than the reading timeout
 
-    for (struct linkedNode *nodeIt = deviceList->head; nodeIt != NULL;
+    for (struct slabLink *nodeIt = deviceList->head; nodeIt != NULL;
          nodeIt = nodeIt->next) {
 
-        packet1 = nodeIt->data;
+        packet1 = getReading(nodeIt);
         node1 = getNode(packet1->nodeNum);
         if (node1 != NULL) {
             numNodes++;
@@ -381,7 +468,7 @@ void localiseDevice(struct linkedList *deviceList, struct linkedList *locationLi
     }
 
     if (deviceList->size == 1 && numNodes > 0) { //Can only assume a radius around one node
-        packet1 = deviceList->head->data;
+        packet1 = getReading(deviceList->head);
         node1 = getNode(packet1->nodeNum);
         if (node1 != NULL) {
             xPos = node1->x;
@@ -389,9 +476,9 @@ void localiseDevice(struct linkedList *deviceList, struct linkedList *locationLi
             havePosition = 1;
         }
     } else if (deviceList->size == 2 && numNodes > 0) { //2 possible solutions, pick node with closer distance
-        packet1 = deviceList->head->data;
+        packet1 = getReading(deviceList->head);
         node1 = getNode(packet1->nodeNum);
-        packet2 = deviceList->tail->data;
+        packet2 = getReading(deviceList->tail);
         node2 = getNode(packet2->nodeNum);
 
         if (node1 != NULL && node2 != NULL) {
@@ -418,7 +505,7 @@ void localiseDevice(struct linkedList *deviceList, struct linkedList *locationLi
         }
     } else if (deviceList->size > 2 && numNodes > 2) {  //Enough data to use multilateration in 2D
         double anchorDistance;
-        struct linkedNode *startListNode = NULL;
+        struct slabLink *startListNode = NULL;
         int numRows = numNodes - 1;
         int numCols = 2;    //2 for 2d, 3 for 3d
 
@@ -429,10 +516,10 @@ void localiseDevice(struct linkedList *deviceList, struct linkedList *locationLi
         gsl_vector *res = gsl_vector_alloc(numRows);//rows will always be bigger than cols
 
         //Find the first node and use as anchor node
-        for (struct linkedNode *nodeIt = deviceList->head; nodeIt != NULL;
+        for (struct slabLink *nodeIt = deviceList->head; nodeIt != NULL;
              nodeIt = nodeIt->next) {
 
-            packet1 = nodeIt->data;
+            packet1 = getReading(nodeIt);
             node1 = getNode(packet1->nodeNum);
             if (node1 != NULL) {
                 startListNode = nodeIt->next;
@@ -444,10 +531,10 @@ void localiseDevice(struct linkedList *deviceList, struct linkedList *locationLi
 
         //Create A and B from co-ordinates and distances
         int i = 0;
-        for (struct linkedNode *nodeIt = startListNode; nodeIt != NULL;
+        for (struct slabLink *nodeIt = startListNode; nodeIt != NULL;
              nodeIt = nodeIt->next) {
 
-            packet2 = nodeIt->data;
+            packet2 = getReading(nodeIt);
             node2 = getNode(packet2->nodeNum);
             if (node2 != NULL) {
                 gsl_matrix_set(A, i, 0, calculateElementA(node1->x, node2->x));
@@ -476,26 +563,27 @@ void localiseDevice(struct linkedList *deviceList, struct linkedList *locationLi
         gsl_vector_free(res);
     }
 
-    pthread_mutex_unlock(&deviceList->mutex);
+    unlockSlabList(deviceList);
 
     //If there is a position inside the bounds, send it
     if (havePosition) {
-        struct wisnLocation *location = malloc(sizeof(struct wisnLocation));
+        struct wisnLocation *location = slabAlloc(&locationSlab);
         location->mac = charsToui64(packet1->mac);
         location->x = xPos;
         location->y = yPos;
-        addDataToTailList(locationList, location);
+        addToTailSlabList(locationList, &location->link);
 
         while (locationList->size > LOC_NUM_AVG) {
-            removeFromHeadList(locationList, LIST_NO_LOCK, LIST_DELETE_DATA);
+            removeFromHeadSlabList(locationList, LIST_NO_LOCK, LIST_DELETE_DATA);
         }
 
         //Calculate approximate device area
         double radius = calculateArea(locationList, &xPos, &yPos);
 
-        printf("Type %d - %02X:%02X:%02X:%02X:%02X:%02X at (%.1f, %.1f) R %.1f\n",
-               havePosition, packet1->mac[0], packet1->mac[1], packet1->mac[2],
-               packet1->mac[3], packet1->mac[4], packet1->mac[5], xPos, yPos, radius);
+        logMessage(LOG_LEVEL_DEBUG, LOG_CLASS_POSITION,
+                   "Type %d - %02X:%02X:%02X:%02X:%02X:%02X at (%.1f, %.1f) R %.1f",
+                   havePosition, packet1->mac[0], packet1->mac[1], packet1->mac[2],
+                   packet1->mac[3], packet1->mac[4], packet1->mac[5], xPos, yPos, radius);
         updatePositionDB(packet1, xPos, yPos, radius);
         JSONisePosition(packet1, xPos, yPos, radius, buffer, ARRAY_SIZE(buffer));
         mosquitto_publish(mosqConn, NULL, POSITIONS_TOPIC, strlen(buffer),
@@ -503,22 +591,23 @@ void localiseDevice(struct linkedList *deviceList, struct linkedList *locationLi
     }
 }
 
-/* Iterates through data and removes anything older than 60 seconds than the
- * newest data.
+/* Iterates through data and removes anything older than the reading timeout.
+ * Nodes only report a device again once its average changes or their silence
+ * timeout passes, so a node's last reading stands until then.
  */
-void removeOldData(struct linkedList *deviceList) {
+void removeOldData(struct slabList *deviceList) {
     if (deviceList->size > 1) {
-        struct linkedNode *node;
-        struct linkedNode *nextNode;
+        struct slabLink *node;
+        struct slabLink *nextNode;
         struct wisnPacket *packet;
         time_t now = time(NULL);
 
         node = deviceList->head;    //Head will have oldest data
         while (node != NULL) {
-            packet = node->data;
-            if (lDiff(now, packet->timestamp) > TIMEOUT) {
+            packet = getReading(node);
+            if (lDiff(now, packet->timestamp) > readingTimeout) {
                 nextNode = node->next;
-                removeNode(deviceList, node, LIST_HAVE_LOCK, LIST_DELETE_DATA);
+                removeSlabNode(deviceList, node, LIST_HAVE_LOCK, LIST_DELETE_DATA);
                 node = nextNode;
             } else {    //Stop if current packet hasn't timed out, because all other packets are newer
                 break;
@@ -631,7 +720,8 @@ void updateNodes(void) {
     while (mongoc_cursor_next(cursor, &doc)) {
         data = bson_as_json(doc, NULL);
         node = readJson(JSON_NODE, data);
-        printf("Node: %d at %f,%f\n", node->nodeNum, node->x, node->y);
+        logMessage(LOG_LEVEL_INFO, LOG_CLASS_GENERAL, "Node: %d at %f,%f", node->nodeNum,
+                   node->x, node->y);
 
         addDataToTailList(&nodeList, node); //Put nodes in a list
 
@@ -685,6 +775,13 @@ void updateNodes(void) {
  * struct type.
  */
 void *readJson(enum jsonType type, const char *json) {
+    return readJsonLength(type, json, strlen(json));
+}
+
+/* Reads the first length characters of the given JSON, which need not be
+ * terminated, and converts it and returns the specified struct type.
+ */
+void *readJsonLength(enum jsonType type, const char *json, size_t length) {
     char *dataCopy;
     char *it;
     enum parseState state;
@@ -697,6 +794,7 @@ void *readJson(enum jsonType type, const char *json) {
     //Check which struct needs to be initialised
     if (type == JSON_DEVICE) {
         wisnPacket = malloc(sizeof(*wisnPacket));
+        wisnPacket->rssiDeviation = 0.0;    //Older nodes don't send it
     } else if (type == JSON_NODE) {
         wisnNode = malloc(sizeof(*wisnNode));
     } else if (type == JSON_CAL) {
@@ -708,8 +806,9 @@ void *readJson(enum jsonType type, const char *json) {
     }
 
     //Copy string since strtok is destructive
-    dataCopy = calloc(strlen(json), sizeof(char));
-    strncpy(dataCopy, json, strlen(json));
+    dataCopy = malloc(length + 1);
+    memcpy(dataCopy, json, length);
+    dataCopy[length] = '\0';
     state = PARSE_NONE;
 
     it = strtok(dataCopy, JSON_DELIMS);
@@ -724,6 +823,8 @@ void *readJson(enum jsonType type, const char *json) {
                     state = PARSE_MAC;
                 } else if (type == JSON_DEVICE && strcmp(it, "rssi") == 0) {
                     state = PARSE_RSSI;
+                } else if (type == JSON_DEVICE && strcmp(it, "sd") == 0) {
+                    state = PARSE_DEVIATION;
                 } else if ((type == JSON_NODE || type == JSON_CAL) && strcmp(it, "name") == 0) {
                     state = PARSE_NAME;
                 } else if ((type == JSON_NODE || type == JSON_CAL) && strcmp(it, "x") == 0) {
@@ -745,6 +846,8 @@ void *readJson(enum jsonType type, const char *json) {
                     }
                 } else if (state == PARSE_RSSI) {
                     wisnPacket->rssi = strtol(it, NULL, 10);
+                } else if (state == PARSE_DEVIATION) {
+                    wisnPacket->rssiDeviation = strtod(it, NULL);
                 } else if (state == PARSE_NAME) {
                     if (type == JSON_NODE) {    //Get node number
                         int marker = strcspn(it, "0123456789");
@@ -822,8 +925,8 @@ void updateCalibration(void) {
     while (mongoc_cursor_next(cursor, &doc)) {
         data = bson_as_json(doc, NULL);
         cal = readJson(JSON_CAL, data);
-        printf("Point %s at %f,%f of distance %f\n", cal->name, cal->x, cal->y,
-               cal->calibration);
+        logMessage(LOG_LEVEL_INFO, LOG_CLASS_GENERAL, "Point %s at %f,%f of distance %f",
+                   cal->name, cal->x, cal->y, cal->calibration);
         addDataToTailList(&calList, cal);
         bson_free(data);
     }
@@ -859,7 +962,7 @@ void updateCalibration(void) {
         pointsPerMeter = max(xDist, yDist) / cal->calibration;
     }
 
-    printf("Calibration factor is %f\n", pointsPerMeter);
+    logMessage(LOG_LEVEL_INFO, LOG_CLASS_GENERAL, "Calibration factor is %f", pointsPerMeter);
 
     if (pthread_mutex_unlock(&(calList.mutex))) {
         fprintf(stderr, "Error releasing list mutex.\n");
@@ -922,31 +1025,40 @@ struct wisnNode *getNode(unsigned short nodeNum) {
     }
 }
 
-/* Stores the given packet in the hashmap of devices.
+/* Returns the packet held by the device reading with the given links.
+ */
+struct wisnPacket *getReading(struct slabLink *link) {
+    return &slabListEntryOf(link, struct deviceReading, link)->packet;
+}
+
+/* Stores a copy of the given packet in the hashmap of devices.
  * Returns the list of all packets for the device the packet is from.
  */
-struct linkedList *storeWisnPacket(struct wisnPacket *packet) {
-    struct linkedList *list;
+struct slabList *storeWisnPacket(struct wisnPacket *packet) {
+    struct slabList *list;
+    struct deviceReading *reading;
     unsigned long long mac;
 
     mac = charsToui64(packet->mac);
     khint64_t devIt = kh_get(devM, deviceMap, mac);
     if (devIt != kh_end(deviceMap)) {   //list already exists
-        struct linkedNode *node;
-        struct linkedNode *nextNode;
+        struct slabLink *node;
+        struct slabLink *nextNode;
         list = kh_value(deviceMap, devIt);
         node = list->head;
         while (node != NULL) {  //Only want latest packet from each node so remove old ones
-            struct wisnPacket *oldPacket = node->data;
+            struct wisnPacket *oldPacket = getReading(node);
             if (oldPacket->nodeNum == packet->nodeNum) {
                 nextNode = node->next;
-                removeNode(list, node, LIST_NO_LOCK, LIST_DELETE_DATA);
+                removeSlabNode(list, node, LIST_NO_LOCK, LIST_DELETE_DATA);
                 node = nextNode;
             } else {
                 node = node->next;
             }
         }
-        addDataToTailList(list, packet);
+        reading = slabAlloc(&readingSlab);
+        reading->packet = *packet;
+        addToTailSlabList(list, &reading->link);
     } else {    //This device is unregistered - no list exists yet
         list = NULL;
     }
@@ -956,15 +1068,15 @@ struct linkedList *storeWisnPacket(struct wisnPacket *packet) {
 
 /* Returns the list of previous calculated locations for the given device.
  */
-struct linkedList *getLocationList(unsigned char *mac) {
-    struct linkedList *list;
+struct slabList *getLocationList(unsigned char *mac) {
+    struct slabList *list;
     int ret;
     unsigned long long devMac = charsToui64(mac);
 
     khint64_t locIt = kh_get(locM, locationMap, devMac);
     if (locIt == kh_end(locationMap)) {   //list doesn't exist
-        list = malloc(sizeof(struct linkedList));
-        initList(list);
+        list = malloc(sizeof(*list));
+        initSlabList(list, &locationSlab, offsetof(struct wisnLocation, link), LIST_NO_LOCK);
         locIt = kh_put(locM, locationMap, devMac, &ret);
         kh_value(locationMap, locIt) = list;
     } else {
@@ -987,7 +1099,8 @@ void updatePositionDB(struct wisnPacket *packet, double x, double y, double radi
     bson_t *query = BCON_NEW("mac", BCON_UTF8(macString));
     bson_t *data = BCON_NEW("$set", "{", "x", BCON_DOUBLE(x), "y", BCON_DOUBLE(y), "r", BCON_DOUBLE(radius), "}");
     if (!mongoc_collection_update(positionsCol, MONGOC_UPDATE_UPSERT, query, data, NULL, &error)) {
-        printf("Error inserting position: %s\n", error.message);
+        logMessage(LOG_LEVEL_ERROR, LOG_CLASS_POSITION, "Error inserting position: %s",
+                   error.message);
     }
 
     bson_destroy(data);
@@ -1015,9 +1128,11 @@ void updateRegisteredUsers(void) {
     struct wisnUser *user;
     unsigned long long mac;
     struct linkedList userList;
-    struct linkedList *list;
+    struct slabList *list;
     struct linkedNode *tempNode;
     int ret;
+    unsigned long long *keys;
+    unsigned int numKeys = 0;
 
     initList(&userList);
 
@@ -1028,8 +1143,9 @@ void updateRegisteredUsers(void) {
     while (mongoc_cursor_next(cursor, &doc)) {
         data = bson_as_json(doc, NULL);
         user = readJson(JSON_USER, data);
-        printf("User: %02X%02X%02X%02X%02X%02X\n", user->mac[0], user->mac[1],
-               user->mac[2], user->mac[3], user->mac[4], user->mac[5]);
+        logMessage(LOG_LEVEL_INFO, LOG_CLASS_GENERAL, "User: %02X%02X%02X%02X%02X%02X",
+                   user->mac[0], user->mac[1], user->mac[2], user->mac[3], user->mac[4],
+                   user->mac[5]);
 
         addDataToTailList(&userList, user); //Put users in a list
 
@@ -1038,6 +1154,23 @@ void updateRegisteredUsers(void) {
 
     mongoc_cursor_destroy(cursor);
 
+    //Nodes are sent the registered MACs so they can drop everything else
+    //An empty set is still sent, telling them no device is registered
+    keys = NULL;
+    if (userList.size > 0) {
+        keys = malloc(userList.size * sizeof(*keys));
+    }
+    if (keys == NULL && userList.size > 0) {
+        logMessage(LOG_LEVEL_ERROR, LOG_CLASS_GENERAL,
+                   "Out of memory for registered devices, nodes keep their last set");
+    } else {
+        for (struct linkedNode *nodeIt = userList.head; nodeIt != NULL; nodeIt = nodeIt->next) {
+            user = nodeIt->data;
+            keys[numKeys++] = macToKey(user->mac);
+        }
+        publishRegisteredUsers(keys, numKeys);
+    }
+
     //Check that all existing device lists are still valid
     for (khint64_t it = kh_begin(deviceMap); it != kh_end(deviceMap); it++) {
         if (kh_exist(deviceMap, it)) {
@@ -1058,7 +1191,7 @@ void updateRegisteredUsers(void) {
 
             if (!foundUser) {   //Didn't find this user, so need to delete it
                 list = kh_value(deviceMap, it);
-                destroyList(list, LIST_DELETE_DATA);
+                destroySlabList(list, LIST_DELETE_DATA);
                 free(list);
                 kh_del(devM, deviceMap, it);
 
@@ -1066,7 +1199,7 @@ void updateRegisteredUsers(void) {
                 khint64_t locIt = kh_get(locM, locationMap, kh_key(deviceMap, it));
                 if (locIt != kh_end(locationMap)) {   //There is data to delete
                     list = kh_value(locationMap, locIt);
-                    destroyList(list, LIST_DELETE_DATA);
+                    destroySlabList(list, LIST_DELETE_DATA);
                     free(list);
                     kh_del(locM, locationMap, locIt);
                 }
@@ -1081,8 +1214,8 @@ void updateRegisteredUsers(void) {
 
             user = nodeIt->data;
             mac = charsToui64(user->mac);
-            list = malloc(sizeof(struct linkedList));
-            initList(list);
+            list = malloc(sizeof(*list));
+            initSlabList(list, &readingSlab, offsetof(struct deviceReading, link), LIST_NO_LOCK);
             khint64_t devIt = kh_put(devM, deviceMap, mac, &ret);
             kh_value(deviceMap, devIt) = list;
         }
@@ -1091,18 +1224,62 @@ void updateRegisteredUsers(void) {
     destroyList(&userList, LIST_DELETE_DATA);
 }
 
+/* Publishes the given registered MACs as a retained sorted set, so nodes
+ * connecting later get the latest one. Takes ownership of keys.
+ */
+void publishRegisteredUsers(unsigned long long *keys, unsigned int numKeys) {
+    struct macFilter filter;
+    unsigned char *buffer;
+    unsigned int length;
+    int res;
+
+    buildMacFilter(&filter, keys, numKeys, ++filterGeneration);
+
+    if (filter.size > MAC_FILTER_MAX) {
+        logMessage(LOG_LEVEL_ERROR, LOG_CLASS_GENERAL,
+                   "%u registered devices is more than any node accepts, nodes keep their last set",
+                   filter.size);
+    } else if (filter.size > MAC_FILTER_STATIC_MAX) {
+        logMessage(LOG_LEVEL_WARN, LOG_CLASS_GENERAL,
+                   "%u registered devices is more than static build nodes hold (%u), "
+                   "they keep their last set", filter.size, MAC_FILTER_STATIC_MAX);
+    }
+
+    length = getMacFilterLength(&filter);
+    buffer = malloc(length);
+    if (buffer == NULL) {
+        logMessage(LOG_LEVEL_ERROR, LOG_CLASS_GENERAL,
+                   "Out of memory for registered devices, nodes keep their last set");
+        destroyMacFilter(&filter);
+        return;
+    }
+    serialiseMacFilter(&filter, buffer, length);
+
+    res = mosquitto_publish(mosqConn, NULL, REGISTERED_TOPIC, length, buffer, 1, 1);
+    if (res != MOSQ_ERR_SUCCESS) {
+        logMessage(LOG_LEVEL_WARN, LOG_CLASS_GENERAL,
+                   "Failed to publish registered devices: %s", mosquitto_strerror(res));
+    } else {
+        logMessage(LOG_LEVEL_INFO, LOG_CLASS_GENERAL, "Published %u registered devices",
+                   filter.size);
+    }
+
+    free(buffer);
+    destroyMacFilter(&filter);
+}
+
 /* Calculates the circular area all given locations fit inside.
  */
-double calculateArea(struct linkedList *list, double *xPos, double *yPos) {
+double calculateArea(struct slabList *list, double *xPos, double *yPos) {
     struct wisnLocation *location;
     double minX = 256.0;
     double minY = 256.0;
     double maxX = 0.0;
     double maxY = 0.0;
-    struct linkedNode *node = list->head;
+    struct slabLink *node = list->head;
 
     while (node != NULL) {
-        location = node->data;
+        location = slabListEntryOf(node, struct wisnLocation, link);
 
         if (location->x > maxX) {
             maxX = location->x;
@@ -18,12 +18,16 @@
 #include <mongoc.h>
 
 #include "linked_list.h"
+#include "slab_list.h"
+#include "ring_queue.h"
+#include "wisn_log.h"
 #include "wisn_packet.h"
 #include "wisn_node.h"
 #include "wisn_calibration.h"
 #include "wisn_version.h"
 #include "wisn_user.h"
 #include "wisn_location.h"
+#include "mac_filter.h"
 #include "mqtt.h"
 #include "khash.h"
 
@@ -35,7 +39,7 @@
 #define EVENT_NODE "nodeUpdate"
 #define EVENT_CAL "calibrationUpdate"
 #define EVENT_USER "userUpdate"
-#define TIMEOUT 10
+#define TIMEOUT 10             //Default seconds a reading stays valid
 #define DB_URL "mongodb://localhost:27020/"
 #define DB_NAME "wisn"
 #define DB_COL_NODES "nodes"
@@ -43,12 +47,20 @@
 #define DB_COL_CALIBRATION "calibration"
 #define DB_COL_REGISTERED "names"
 #define LOC_NUM_AVG 32
+#define DATA_QUEUE_SIZE 16384  //Received readings waiting for processing
+#define DATA_BATCH_SIZE 64     //Readings taken off the queue at a time
 
-enum argState {ARG_NONE, ARG_BROKER, ARG_PORT};
-enum parseState {PARSE_NODENUM, PARSE_TIME, PARSE_MAC, PARSE_RSSI, PARSE_NAME,
-                 PARSE_X, PARSE_Y, PARSE_NONE};
+enum argState {ARG_NONE, ARG_BROKER, ARG_PORT, ARG_LOG, ARG_TIMEOUT};
+enum parseState {PARSE_NODENUM, PARSE_TIME, PARSE_MAC, PARSE_RSSI, PARSE_DEVIATION,
+                 PARSE_NAME, PARSE_X, PARSE_Y, PARSE_NONE};
 enum jsonType {JSON_DEVICE, JSON_NODE, JSON_CAL, JSON_USER};
 
+//Struct for the last reading of a device from one node, kept in the device's list
+struct deviceReading {
+    struct slabLink link;
+    struct wisnPacket packet;
+};
+
 // static const char * const defaultDBURL = "mongodb://localhost:27020/";
 // static const char * const dbName = "wisn";
 // static const char * const nodesColName = "nodes";
@@ -63,12 +75,15 @@ void destroyStoredData(void);
 unsigned int connectToBroker(char *address, int port);
 void receivedMessage(struct mosquitto *conn, void *args, const struct mosquitto_message *message);
 void receivedDeviceMessage(const struct mosquitto_message *message);
+void receivedBatchMessage(const struct mosquitto_message *message);
+void receivedBinaryMessage(const struct mosquitto_message *message);
+char hasSuffix(const char *string, const char *suffix);
 void ui64ToChars(unsigned long long mac, unsigned char *dest);
 unsigned long long charsToui64(unsigned char *mac);
 unsigned char parseHexChar(char *string);
 void stringToMAC(char *string, unsigned char *mac);
-void localiseDevice(struct linkedList *deviceList, struct linkedList *locationList);
-void removeOldData(struct linkedList *deviceList);
+void localiseDevice(struct slabList *deviceList, struct slabList *locationList);
+void removeOldData(struct slabList *deviceList);
 double getDistance(double rssi);
 double calculateElementA(double xk, double xi);
 double calculateElementB2D(double distancei, double distancek, double xi, double yi, double xk, double yk);
@@ -79,6 +94,7 @@ void initialiseDBConnection(char *url, char *dbName);
 void cleanupDB(void);
 void updateNodes(void);
 void *readJson(enum jsonType type, const char *json);
+void *readJsonLength(enum jsonType type, const char *json, size_t length);
 char *findCharStart(char *string);
 void updateCalibration(void);
 double max(double a, double b);
@@ -86,11 +102,13 @@ double min(double a, double b);
 double dDiff(double a, double b);
 long lDiff(long a, long b);
 struct wisnNode *getNode(unsigned short nodeNum);
-struct linkedList *storeWisnPacket(struct wisnPacket *packet);
-struct linkedList *getLocationList(unsigned char *mac);
+struct wisnPacket *getReading(struct slabLink *link);
+struct slabList *storeWisnPacket(struct wisnPacket *packet);
+struct slabList *getLocationList(unsigned char *mac);
 void updatePositionDB(struct wisnPacket *packet, double x, double y, double radius);
 void JSONisePosition(struct wisnPacket *packet, double xPos, double yPos, double radius, char *buffer, int size);
 void updateRegisteredUsers(void);
-double calculateArea(struct linkedList *list, double *xPos, double *yPos);
+void publishRegisteredUsers(unsigned long long *keys, unsigned int numKeys);
+double calculateArea(struct slabList *list, double *xPos, double *yPos);
 
 #endif